@@ -0,0 +1,530 @@
+/*******************************************************
+ Simulated customHID device for hidtest
+
+ Stands in for HIDAPI and a customHID board, so that
+ hidtest can be exercised without hardware:
+
+   g++ -O2 -DHIDSIM -o hidtest-sim hidtest.cpp hidsim.cpp -lpthread
+
+ The device is advanced in 1 ms USB frames against the
+ wall clock. In each frame the host gets at most one
+ interrupt IN and one interrupt OUT transaction on EP1
+ (bInterval is 1 ms), and then the firmware's main
+ loop in main.c runs; it is never quick enough to act
+ in the microseconds between two transactions of one
+ frame.  The firmware model follows main.c: EP1 is
+ ping-ponged, so the SIE holds up to two OUT reports
+ and two IN replies, and an OUT report is held back
+ while both IN buffers are in use.  0x80 increments a
+ counter, 0x81 returns it in an IN report, and
+ CMD_BATCH reports are run as by ExecuteBatch().
+ HIDSIM_PING_PONG=0 instead models the earlier
+ PPB_NONE build, with one buffer each way.
+
+ As with HIDAPI's libusb backend, hid_write() returns
+ once its OUT transaction has completed.
+
+ The feature report is stored by Set_Report and read
+ back by Get_Report, as by the handlers in main.c.  A
+ control transfer takes the rest of the frame it is
+ started in: its few 64-byte EP0 packets go in the
+ bus time left over by the periodic transactions.
+
+ HIDSIM_APP_LOAD_CYCLES models APP_LOAD_CYCLES: each
+ pass of the main loop then takes that many instruction
+ cycles (at 12 MIPS), and carries out at most one report;
+ without it, the main loop is taken to keep up with
+ anything.  HIDSIM_INTERRUPTS=1 models the
+ USB_USE_INTERRUPTS build: each OUT report is moved into
+ the OUT_QUEUE_LEN entry queue, and its buffer re-armed,
+ as soon as it arrives, and the main loop works through
+ the queue instead, only holding back a report that
+ needs a reply while both IN buffers are in use.  The
+ time spent in isr() is not modelled.
+
+ HIDSIM_DEVICES (default 1) sets how many boards are
+ attached, as paths sim:0, sim:1, ...  They share one
+ full-speed bus, which fits HIDSIM_FRAME_BUDGET 64-byte
+ interrupt transactions per frame (default 17: about
+ 19 fit in a frame, of which 90% may be periodic);
+ beyond that, transactions wait for a later frame.
+ Each device may be driven from its own thread.
+********************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "hidsim.h"
+
+#define SIM_VID 0x04d8
+#define SIM_PID 0x003f
+#define SIM_REPORT_LEN 64 // EP_1_IN_LEN and EP_1_OUT_LEN
+#define SIM_FEATURE_LEN 256 // FEATURE_REPORT_LEN
+#define SIM_QUEUE_LEN 32 // reports the host buffers from EP1 IN before dropping them
+#define SIM_MAX_DEVICES 127
+#define SIM_BUS_FRAMES 64 // frames of bus bookkeeping kept, for devices catching up
+#define SIM_CYCLES_PER_FRAME 12000 // instruction cycles in 1 ms at 48 MHz
+#define SIM_OUT_QUEUE_LEN 4 // OUT_QUEUE_LEN
+
+struct hid_device_ {
+	int index;
+	int nonblocking;
+	long long frame; // last frame simulated
+
+	// host side
+	unsigned char out_report[SIM_REPORT_LEN];
+	int out_pending; // out_report waits for an OUT transaction
+	unsigned char in_queue[SIM_QUEUE_LEN][SIM_REPORT_LEN];
+	int in_head, in_count;
+
+	// device side (main.c)
+	unsigned char rx[2][SIM_REPORT_LEN]; // EP1 OUT buffers holding a report, i.e. not armed
+	int rx_head, rx_count;
+	unsigned char tx[2][SIM_REPORT_LEN]; // EP1 IN buffers handed to the SIE
+	int tx_head, tx_count;
+	unsigned char queue[SIM_OUT_QUEUE_LEN][SIM_REPORT_LEN]; // out_queue, with interrupts
+	int queue_head, queue_count;
+	long cycles; // into the current pass of the main loop, with a load
+	unsigned char counter;
+	unsigned char feature[SIM_FEATURE_LEN];
+};
+
+static struct timespec sim_epoch;
+static int sim_devices = 1;
+static int frame_budget = 17;
+static int ping_pong_buffers = 2;
+static long app_load_cycles;
+static int interrupts;
+
+// interrupt transactions scheduled in each recent frame, across all devices
+static pthread_mutex_t bus_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+	long long frame;
+	int used;
+} bus[SIM_BUS_FRAMES];
+
+// claim a transaction slot in the given frame; false if the frame is full
+static int bus_claim(long long frame)
+{
+	int ok;
+
+	pthread_mutex_lock(&bus_lock);
+	if (bus[frame % SIM_BUS_FRAMES].frame != frame) {
+		bus[frame % SIM_BUS_FRAMES].frame = frame;
+		bus[frame % SIM_BUS_FRAMES].used = 0;
+	}
+	ok = bus[frame % SIM_BUS_FRAMES].used < frame_budget;
+	if (ok)
+		bus[frame % SIM_BUS_FRAMES].used++;
+	pthread_mutex_unlock(&bus_lock);
+	return ok;
+}
+
+static long long current_frame(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - sim_epoch.tv_sec) * 1000LL + (now.tv_nsec - sim_epoch.tv_nsec) / 1000000L;
+}
+
+static void sleep_to_next_frame(void)
+{
+	struct timespec now;
+	long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (now.tv_nsec - sim_epoch.tv_nsec) % 1000000L;
+	if (ns < 0)
+		ns += 1000000L;
+	usleep((1000000L - ns) / 1000 + 1);
+}
+
+#define CMD_BATCH 0xC0
+#define NO_ROOM 0xFF
+
+// ExecuteCommand() in main.c
+static int execute_command(hid_device *dev, unsigned char command, unsigned char *data, int room)
+{
+	if (command == 0x80) {
+		dev->counter++;
+	}
+	else if (command == 0x81) {
+		if (room < 1)
+			return NO_ROOM;
+		data[0] = dev->counter;
+		return 1;
+	}
+	return 0;
+}
+
+// ExecuteBatch() in main.c
+static void execute_batch(hid_device *dev, const unsigned char *rx, unsigned char *tx)
+{
+	int in = 2, out = 3, done = 0, len, result;
+
+	tx[1] = rx[1];
+	while (in < SIM_REPORT_LEN) {
+		len = rx[in];
+		if (len == 0 || len > SIM_REPORT_LEN - 1 - in)
+			break;
+
+		result = execute_command(dev, rx[in + 1], &tx[out + 2],
+			(out < SIM_REPORT_LEN - 2) ? SIM_REPORT_LEN - 2 - out : 0);
+		if (result == NO_ROOM)
+			break;
+		if (result) {
+			tx[out] = result + 1;
+			tx[out + 1] = rx[in + 1];
+			out += result + 2;
+		}
+		in += len + 1;
+		done++;
+	}
+	tx[2] = done;
+	if (out < SIM_REPORT_LEN)
+		tx[out] = 0;
+}
+
+// ProcessReport() in main.c; false if the report is held back for want of an IN buffer
+static int process_report(hid_device *dev, const unsigned char *rx)
+{
+	unsigned char *tx = dev->tx[(dev->tx_head + dev->tx_count) % 2];
+	int reply = (rx[0] == CMD_BATCH || rx[0] == 0x81);
+
+	// the polling main loop waits for a free IN buffer before it looks at an OUT report;
+	// working from the queue, only a report for which CommandHasReply() waits for one
+	if ((reply || !interrupts) && dev->tx_count == ping_pong_buffers)
+		return 0;
+
+	tx[0] = rx[0];
+	if (rx[0] == CMD_BATCH)
+		execute_batch(dev, rx, tx);
+	else
+		execute_command(dev, rx[0], &tx[1], SIM_REPORT_LEN - 1);
+	if (reply)
+		dev->tx_count++;
+	return 1;
+}
+
+// TakeOutReports() in main.c: with interrupts, OUT reports go into the queue, and their buffers are re-armed
+static void take_out_reports(hid_device *dev)
+{
+	while (dev->queue_count < SIM_OUT_QUEUE_LEN && dev->rx_count) {
+		memcpy(dev->queue[(dev->queue_head + dev->queue_count) % SIM_OUT_QUEUE_LEN], dev->rx[dev->rx_head], SIM_REPORT_LEN);
+		dev->queue_count++;
+		dev->rx_head = (dev->rx_head + 1) % 2;
+		dev->rx_count--;
+	}
+}
+
+// one pass of the main loop, carrying out at most one report; false if there was nothing it could do
+static int main_loop_pass(hid_device *dev)
+{
+	if (interrupts) {
+		if (!dev->queue_count || !process_report(dev, dev->queue[dev->queue_head]))
+			return 0;
+		dev->queue_head = (dev->queue_head + 1) % SIM_OUT_QUEUE_LEN;
+		dev->queue_count--;
+		take_out_reports(dev);
+		return 1;
+	}
+
+	if (!dev->rx_count || !process_report(dev, dev->rx[dev->rx_head]))
+		return 0;
+	// re-armed
+	dev->rx_head = (dev->rx_head + 1) % 2;
+	dev->rx_count--;
+	return 1;
+}
+
+// the firmware's main loop for one frame: to completion, or as many passes as end within the frame under a load
+static void firmware_service(hid_device *dev)
+{
+	if (!app_load_cycles) {
+		while (main_loop_pass(dev))
+			;
+		return;
+	}
+
+	// the loop is busy in its load at the start of every pass, whether or not there is anything to do
+	for (dev->cycles += SIM_CYCLES_PER_FRAME; dev->cycles >= app_load_cycles; dev->cycles -= app_load_cycles)
+		main_loop_pass(dev);
+}
+
+static void run_frame(hid_device *dev)
+{
+	// interrupt IN
+	if (dev->tx_count && bus_claim(dev->frame)) {
+		if (dev->in_count < SIM_QUEUE_LEN) {
+			memcpy(dev->in_queue[(dev->in_head + dev->in_count) % SIM_QUEUE_LEN], dev->tx[dev->tx_head], SIM_REPORT_LEN);
+			dev->in_count++;
+		}
+		dev->tx_head = (dev->tx_head + 1) % 2;
+		dev->tx_count--;
+	}
+
+	// interrupt OUT; NAKed while the firmware hasn't re-armed a buffer
+	if (dev->out_pending && dev->rx_count < ping_pong_buffers && bus_claim(dev->frame)) {
+		memcpy(dev->rx[(dev->rx_head + dev->rx_count) % 2], dev->out_report, SIM_REPORT_LEN);
+		dev->rx_count++;
+		dev->out_pending = 0;
+
+		// app_out_transaction_callback(), from isr()
+		if (interrupts)
+			take_out_reports(dev);
+	}
+
+	firmware_service(dev);
+}
+
+static void catch_up(hid_device *dev)
+{
+	long long now = current_frame();
+
+	// nothing can happen in frames without anything to transfer
+	if (!dev->out_pending && !dev->tx_count && !dev->rx_count && !dev->queue_count) {
+		// though a loaded main loop carries on through its passes regardless
+		if (app_load_cycles)
+			dev->cycles = (dev->cycles + (now - dev->frame) * SIM_CYCLES_PER_FRAME) % app_load_cycles;
+		dev->frame = now;
+	}
+
+	while (dev->frame < now) {
+		dev->frame++;
+		run_frame(dev);
+	}
+}
+
+int hid_init(void)
+{
+	const char *env;
+
+	clock_gettime(CLOCK_MONOTONIC, &sim_epoch);
+
+	env = getenv("HIDSIM_DEVICES");
+	if (env)
+		sim_devices = atoi(env);
+	if (sim_devices < 0)
+		sim_devices = 0;
+	if (sim_devices > SIM_MAX_DEVICES)
+		sim_devices = SIM_MAX_DEVICES;
+
+	env = getenv("HIDSIM_FRAME_BUDGET");
+	if (env)
+		frame_budget = atoi(env);
+
+	env = getenv("HIDSIM_PING_PONG");
+	if (env)
+		ping_pong_buffers = atoi(env) ? 2 : 1;
+
+	env = getenv("HIDSIM_APP_LOAD_CYCLES");
+	if (env)
+		app_load_cycles = atol(env);
+	if (app_load_cycles < 0)
+		app_load_cycles = 0;
+
+	env = getenv("HIDSIM_INTERRUPTS");
+	if (env)
+		interrupts = atoi(env) != 0;
+	return 0;
+}
+
+int hid_exit(void)
+{
+	return 0;
+}
+
+struct hid_device_info *hid_enumerate(unsigned short vendor_id, unsigned short product_id)
+{
+	struct hid_device_info *info, *head = NULL;
+	char path[16];
+	int i;
+
+	if ((vendor_id && vendor_id != SIM_VID) || (product_id && product_id != SIM_PID))
+		return NULL;
+
+	for (i = sim_devices - 1; i >= 0; i--) {
+		info = (struct hid_device_info *)calloc(1, sizeof(*info));
+		snprintf(path, sizeof(path), "sim:%d", i);
+		info->path = strdup(path);
+		info->vendor_id = SIM_VID;
+		info->product_id = SIM_PID;
+		info->serial_number = wcsdup(L"");
+		info->release_number = 0x0003;
+		info->manufacturer_string = wcsdup(L"Acme");
+		info->product_string = wcsdup(L"custom");
+		info->interface_number = 0;
+		info->next = head;
+		head = info;
+	}
+	return head;
+}
+
+void hid_free_enumeration(struct hid_device_info *devs)
+{
+	while (devs) {
+		struct hid_device_info *next = devs->next;
+		free(devs->path);
+		free(devs->serial_number);
+		free(devs->manufacturer_string);
+		free(devs->product_string);
+		free(devs);
+		devs = next;
+	}
+}
+
+hid_device *hid_open_path(const char *path)
+{
+	hid_device *dev;
+	int index;
+	char end;
+
+	if (sscanf(path, "sim:%d%c", &index, &end) != 1 || index < 0 || index >= sim_devices)
+		return NULL;
+
+	dev = (hid_device *)calloc(1, sizeof(*dev));
+	dev->index = index;
+	dev->frame = current_frame();
+	return dev;
+}
+
+hid_device *hid_open(unsigned short vendor_id, unsigned short product_id, const wchar_t *serial_number)
+{
+	(void)serial_number;
+
+	if (vendor_id != SIM_VID || product_id != SIM_PID)
+		return NULL;
+	return hid_open_path("sim:0");
+}
+
+void hid_close(hid_device *dev)
+{
+	free(dev);
+}
+
+int hid_write(hid_device *dev, const unsigned char *data, size_t length)
+{
+	if (length < 1)
+		return -1;
+
+	// report numbers aren't used, so data[0] is always 0 and isn't sent
+	memset(dev->out_report, 0, SIM_REPORT_LEN);
+	memcpy(dev->out_report, data + 1, (length - 1 < SIM_REPORT_LEN) ? length - 1 : SIM_REPORT_LEN);
+	catch_up(dev);
+	dev->out_pending = 1;
+
+	while (dev->out_pending) {
+		sleep_to_next_frame();
+		catch_up(dev);
+	}
+	return (int)length;
+}
+
+int hid_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+{
+	long long deadline = current_frame() + milliseconds;
+
+	for (;;) {
+		catch_up(dev);
+		if (dev->in_count) {
+			if (length > SIM_REPORT_LEN)
+				length = SIM_REPORT_LEN;
+			memcpy(data, dev->in_queue[dev->in_head], length);
+			dev->in_head = (dev->in_head + 1) % SIM_QUEUE_LEN;
+			dev->in_count--;
+			return (int)length;
+		}
+		if (milliseconds == 0 || (milliseconds > 0 && current_frame() >= deadline))
+			return 0;
+		sleep_to_next_frame();
+	}
+}
+
+int hid_read(hid_device *dev, unsigned char *data, size_t length)
+{
+	return hid_read_timeout(dev, data, length, dev->nonblocking ? 0 : -1);
+}
+
+int hid_set_nonblocking(hid_device *dev, int nonblock)
+{
+	dev->nonblocking = nonblock;
+	return 0;
+}
+
+// a control transfer on EP0, done by the end of the current frame
+static void control_transfer(hid_device *dev)
+{
+	catch_up(dev);
+	sleep_to_next_frame();
+	catch_up(dev);
+}
+
+int hid_send_feature_report(hid_device *dev, const unsigned char *data, size_t length)
+{
+	// report numbers aren't used, so data[0] is always 0 and isn't sent; the
+	// firmware takes exactly SIM_FEATURE_LEN bytes, and STALLs anything longer
+	if (length != SIM_FEATURE_LEN + 1)
+		return -1;
+
+	control_transfer(dev);
+	memcpy(dev->feature, data + 1, SIM_FEATURE_LEN);
+	return (int)length;
+}
+
+int hid_get_feature_report(hid_device *dev, unsigned char *data, size_t length)
+{
+	if (length < 1)
+		return -1;
+	if (length > SIM_FEATURE_LEN + 1)
+		length = SIM_FEATURE_LEN + 1;
+
+	control_transfer(dev);
+	memcpy(data + 1, dev->feature, length - 1);
+	return (int)length;
+}
+
+static int copy_string(const wchar_t *s, wchar_t *string, size_t maxlen)
+{
+	if (!maxlen)
+		return -1;
+	wcsncpy(string, s, maxlen);
+	string[maxlen - 1] = 0;
+	return 0;
+}
+
+int hid_get_manufacturer_string(hid_device *dev, wchar_t *string, size_t maxlen)
+{
+	(void)dev;
+	return copy_string(L"Acme", string, maxlen);
+}
+
+int hid_get_product_string(hid_device *dev, wchar_t *string, size_t maxlen)
+{
+	(void)dev;
+	return copy_string(L"custom", string, maxlen);
+}
+
+int hid_get_serial_number_string(hid_device *dev, wchar_t *string, size_t maxlen)
+{
+	(void)dev;
+	return copy_string(L"", string, maxlen);
+}
+
+int hid_get_indexed_string(hid_device *dev, int string_index, wchar_t *string, size_t maxlen)
+{
+	(void)dev;
+	if (string_index == 1)
+		return copy_string(L"Acme", string, maxlen);
+	if (string_index == 2)
+		return copy_string(L"custom", string, maxlen);
+	return -1;
+}
+
+const wchar_t *hid_error(hid_device *dev)
+{
+	(void)dev;
+	return L"simulated device";
+}
@@ -18,30 +18,469 @@
 #include <wchar.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef HIDSIM
+#include "hidsim.h" // hidsim.cpp stands in for HIDAPI and the board
+#else
 #include "hidapi.h"
+#endif
 
 // Headers needed for sleeping.
 #ifdef _WIN32
 	#include <windows.h>
 #else
 	#include <unistd.h>
+	#include <time.h>
+	#include <pthread.h>
 #endif
 
 #define REPORT_NUMBER 0x00
+#define REPORT_LEN 64 // EP_1_IN_LEN and EP_1_OUT_LEN in usb_config.h
+#define FEATURE_LEN 256 // FEATURE_REPORT_LEN in usb_config.h
+#define BENCH_TIMEOUT_MS 1000
+
+// Batched commands (see CMD_BATCH in main.c): a pair is two records,
+// { 1, 0x80 } and { 1, 0x81 }, after the two header bytes, and answers
+// with one 3-byte record after the three header bytes.
+#define CMD_BATCH 0xC0
+#define BATCH_MAX_PAIRS ((REPORT_LEN - 2) / 4)
+#define BATCH_MAX_DEPTH 64
+
+static int bench_batch; // pairs per batched report, or 0 for one command per report
+static int bench_depth = 1; // batched reports kept in flight
+
+// Milliseconds from an arbitrary starting point, for timing transactions.
+static double now_ms(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return count.QuadPart * 1000.0 / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Send a command report and, for 0x81, wait for its reply. Returns the
+// reply's counter value, 0 for a command with no reply, or -1 on error.
+static int command(hid_device *handle, unsigned char cmd)
+{
+	unsigned char buf[REPORT_LEN + 1];
+	int res;
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = REPORT_NUMBER;
+	buf[1] = cmd;
+	if (hid_write(handle, buf, sizeof(buf)) < 0)
+		return -1;
+	if (cmd != 0x81)
+		return 0;
+
+	res = hid_read_timeout(handle, buf, sizeof(buf), BENCH_TIMEOUT_MS);
+	if (res < 2 || buf[0] != 0x81)
+		return -1;
+	return buf[1];
+}
+
+// Ask a board built with ISR_TIMING (see main.c) for the longest isr() since
+// it was last asked, which also starts it afresh; print it if show is set.
+static void isr_cycles(hid_device *handle, int show)
+{
+	unsigned char buf[REPORT_LEN + 1];
+	int res, cycles;
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = REPORT_NUMBER;
+	buf[1] = 0x82;
+	if (hid_write(handle, buf, sizeof(buf)) < 0)
+		return;
+
+	res = hid_read_timeout(handle, buf, sizeof(buf), BENCH_TIMEOUT_MS);
+	if (!show)
+		return;
+	if (res < 3 || buf[0] != 0x82) {
+		printf("no reply to 0x82 (is the firmware built with ISR_TIMING?)\n");
+		return;
+	}
+	cycles = buf[1] | (buf[2] << 8);
+	printf("longest isr(): %d instruction cycles, %.1f us at 12 MIPS\n", cycles, cycles / 12.0);
+}
+
+// One device's share of a benchmark run.
+struct bench {
+	hid_device *handle;
+	char *path;
+	int count; // 0x80/0x81 pairs
+	double *times; // round trip of each transaction or batched report, in ms
+	int samples; // entries in times
+	int reports; // OUT and IN reports exchanged
+	double elapsed;
+	int errors; // replies whose counter hadn't moved on by exactly one
+	int failed; // transactions abandoned on an I/O error or timeout
+};
+
+// Benchmark mode: time b->count back-to-back 0x80/0x81 pairs. Each pair is
+// one transaction of two OUT reports and one IN report, and the counter
+// returned by 0x81 must have moved on by exactly one.
+static void run_benchmark(struct bench *b)
+{
+	unsigned char buf[REPORT_LEN + 1];
+	double start;
+	int i, res, expected;
+
+	hid_set_nonblocking(b->handle, 0);
+
+	// Discard anything left over, and pick up the counter's starting value.
+	while (hid_read_timeout(b->handle, buf, sizeof(buf), 0) > 0)
+		;
+	expected = command(b->handle, 0x81);
+	if (expected < 0) {
+		b->failed = b->count;
+		b->count = 0;
+		return;
+	}
+
+	start = now_ms();
+	for (i = 0; i < b->count; i++) {
+		double t0 = now_ms();
+
+		expected = (expected + 1) & 0xff;
+		if (command(b->handle, 0x80) < 0 || (res = command(b->handle, 0x81)) < 0) {
+			b->failed = b->count - i;
+			break;
+		}
+		b->times[i] = now_ms() - t0;
+
+		if (res != expected) {
+			b->errors++;
+			expected = res;
+		}
+	}
+	b->count = i;
+	b->samples = i;
+	b->reports = i * 3;
+	b->elapsed = now_ms() - start;
+}
+
+// Batched benchmark mode: the same pairs, bench_batch to a CMD_BATCH
+// report, with up to bench_depth reports written ahead of their replies.
+// Replies are matched by sequence number and timed from their request.
+static void run_batch_benchmark(struct bench *b)
+{
+	unsigned char buf[REPORT_LEN + 1];
+	double start, sent_at[256];
+	int pairs_in[256] = { 0 };
+	int sent = 0, in_flight = 0, res, i, pos, expected;
+	unsigned char seq_out = 0, seq_in = 0;
+
+	hid_set_nonblocking(b->handle, 0);
+	while (hid_read_timeout(b->handle, buf, sizeof(buf), 0) > 0)
+		;
+	expected = command(b->handle, 0x81);
+	if (expected < 0) {
+		b->failed = b->count;
+		b->count = 0;
+		return;
+	}
+
+	start = now_ms();
+	b->samples = 0;
+	i = 0; // pairs answered
+	while (i < b->count) {
+		// Keep the pipeline full.
+		while (in_flight < bench_depth && sent < b->count) {
+			int k = b->count - sent;
+			if (k > bench_batch)
+				k = bench_batch;
+
+			memset(buf, 0, sizeof(buf));
+			buf[0] = REPORT_NUMBER;
+			buf[1] = CMD_BATCH;
+			buf[2] = seq_out;
+			for (pos = 3; k; k--, sent++) {
+				buf[pos++] = 1;
+				buf[pos++] = 0x80;
+				buf[pos++] = 1;
+				buf[pos++] = 0x81;
+				pairs_in[seq_out]++;
+			}
+			sent_at[seq_out] = now_ms();
+			if (hid_write(b->handle, buf, sizeof(buf)) < 0)
+				goto failed;
+			seq_out++;
+			in_flight++;
+		}
+
+		res = hid_read_timeout(b->handle, buf, sizeof(buf), BENCH_TIMEOUT_MS);
+		if (res < 3 || buf[0] != CMD_BATCH || buf[1] != seq_in)
+			goto failed;
+		b->times[b->samples++] = now_ms() - sent_at[seq_in];
+
+		// Every command should have run, each 0x81 one count on.
+		if (buf[2] != pairs_in[seq_in] * 2)
+			b->errors++;
+		for (pos = 3; pos + 2 < res && buf[pos]; pos += buf[pos] + 1) {
+			expected = (expected + 1) & 0xff;
+			if (buf[pos] != 2 || buf[pos + 1] != 0x81 || buf[pos + 2] != expected) {
+				b->errors++;
+				expected = buf[pos + 2];
+			}
+		}
+
+		i += pairs_in[seq_in];
+		pairs_in[seq_in] = 0;
+		seq_in++;
+		in_flight--;
+	}
+	goto done;
+
+failed:
+	b->failed = b->count - i;
+done:
+	b->count = i;
+	b->reports = b->samples * 2;
+	b->elapsed = now_ms() - start;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI bench_thread(LPVOID arg)
+#else
+static void *bench_thread(void *arg)
+#endif
+{
+	if (bench_batch)
+		run_batch_benchmark((struct bench *)arg);
+	else
+		run_benchmark((struct bench *)arg);
+	return 0;
+}
+
+static void print_results(const char *label, struct bench *r)
+{
+	printf("%s: %d transactions in %.1f ms, %d with an unexpected counter, %d failed\n",
+		label, r->count, r->elapsed, r->errors, r->failed);
+	if (!r->samples || r->elapsed <= 0)
+		return;
+
+	qsort(r->times, r->samples, sizeof(*r->times), compare_double);
+	printf("  round trip%s (ms): p50 %.3f  p99 %.3f  max %.3f\n", bench_batch ? " per report" : "",
+		r->times[r->samples / 2], r->times[(r->samples * 99) / 100], r->times[r->samples - 1]);
+	printf("  %.1f transactions/s, %.1f reports/s\n",
+		r->count * 1000.0 / r->elapsed, r->reports * 1000.0 / r->elapsed);
+}
+
+// Time count Set_Report/Get_Report round trips of the feature report, each
+// with a different pattern, checking that what comes back is what was sent.
+static int benchmark_feature(hid_device *handle, int count)
+{
+	unsigned char out[FEATURE_LEN + 1], in[FEATURE_LEN + 1];
+	double *times, start, t;
+	int i, j, res, samples = 0, errors = 0, failed = 0;
+
+	times = (double *)malloc(count * sizeof(double));
+	if (!times)
+		return 1;
+
+	start = now_ms();
+	for (i = 0; i < count; i++) {
+		out[0] = REPORT_NUMBER;
+		for (j = 0; j < FEATURE_LEN; j++)
+			out[j + 1] = (unsigned char)(i + j);
+
+		t = now_ms();
+		res = hid_send_feature_report(handle, out, sizeof(out));
+		if (res < 0) {
+			failed++;
+			break;
+		}
+		memset(in, 0, sizeof(in));
+		in[0] = REPORT_NUMBER;
+		res = hid_get_feature_report(handle, in, sizeof(in));
+		if (res < 0) {
+			failed++;
+			break;
+		}
+		times[samples++] = now_ms() - t;
+
+		// HIDAPI counts the report number in what it returns
+		if (res != (int)sizeof(in) || memcmp(in + 1, out + 1, FEATURE_LEN))
+			errors++;
+	}
+	t = now_ms() - start;
+
+	if (failed)
+		printf("Round trip %d failed: %ls\n", samples, hid_error(handle));
+	printf("feature benchmark: %d round trips of %d bytes in %.1f ms, %d mismatched, %d failed\n",
+		samples, FEATURE_LEN, t, errors, failed);
+	if (samples && t > 0) {
+		qsort(times, samples, sizeof(*times), compare_double);
+		printf("  round trip (ms): p50 %.3f  p99 %.3f  max %.3f\n",
+			times[samples / 2], times[(samples * 99) / 100], times[samples - 1]);
+		printf("  %.1f round trips/s, %.1f bytes/s each way\n",
+			samples * 1000.0 / t, samples * FEATURE_LEN * 1000.0 / t);
+	}
+
+	free(times);
+	return (errors || failed) ? 1 : 0;
+}
+
+// Run the benchmark on every customHID device at once, one thread per
+// device, and report each device along with the total across them.
+static int benchmark_all(int count)
+{
+	struct hid_device_info *devs, *cur_dev;
+	struct bench *b, total;
+	int n = 0, i;
+
+	devs = hid_enumerate(0x4d8, 0x3f);
+	for (cur_dev = devs; cur_dev; cur_dev = cur_dev->next)
+		n++;
+	if (!n) {
+		printf("no devices found\n");
+		return 1;
+	}
+
+	b = (struct bench *)calloc(n, sizeof(*b));
+	n = 0;
+	for (cur_dev = devs; cur_dev; cur_dev = cur_dev->next) {
+		b[n].handle = hid_open_path(cur_dev->path);
+		if (!b[n].handle) {
+			printf("unable to open %s\n", cur_dev->path);
+			continue;
+		}
+		b[n].path = strdup(cur_dev->path);
+		b[n].count = count;
+		b[n].times = (double *)malloc(count * sizeof(double));
+		n++;
+	}
+	hid_free_enumeration(devs);
+	if (!n) {
+		free(b);
+		return 1;
+	}
+
+	{
+#ifdef _WIN32
+		HANDLE *threads = (HANDLE *)calloc(n, sizeof(HANDLE));
+		for (i = 0; i < n; i++)
+			threads[i] = CreateThread(NULL, 0, bench_thread, &b[i], 0, NULL);
+		for (i = 0; i < n; i++) {
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+#else
+		pthread_t *threads = (pthread_t *)calloc(n, sizeof(pthread_t));
+		for (i = 0; i < n; i++)
+			pthread_create(&threads[i], NULL, bench_thread, &b[i]);
+		for (i = 0; i < n; i++)
+			pthread_join(threads[i], NULL);
+#endif
+		free(threads);
+	}
+
+	memset(&total, 0, sizeof(total));
+	total.times = (double *)malloc((size_t)n * count * sizeof(double));
+	for (i = 0; i < n; i++) {
+		// The threads start together, so the slowest device sets the wall time.
+		memcpy(total.times + total.samples, b[i].times, b[i].samples * sizeof(double));
+		total.samples += b[i].samples;
+		total.count += b[i].count;
+		total.reports += b[i].reports;
+		total.errors += b[i].errors;
+		total.failed += b[i].failed;
+		if (b[i].elapsed > total.elapsed)
+			total.elapsed = b[i].elapsed;
+
+		print_results(b[i].path, &b[i]);
+		hid_close(b[i].handle);
+		free(b[i].times);
+		free(b[i].path);
+	}
+
+	char label[32];
+	snprintf(label, sizeof(label), "all %d devices", n);
+	print_results(label, &total);
+
+	free(total.times);
+	free(b);
+	return (total.errors || total.failed) ? 1 : 0;
+}
+
+static int benchmark(hid_device *handle, int count)
+{
+	struct bench b;
+
+	memset(&b, 0, sizeof(b));
+	b.handle = handle;
+	b.count = count;
+	b.times = (double *)malloc(count * sizeof(double));
+	if (!b.times)
+		return 1;
+
+	bench_thread(&b);
+	if (b.failed)
+		printf("Transaction %d failed: %ls\n", b.count, hid_error(handle));
+	print_results("benchmark", &b);
+
+	free(b.times);
+	return (b.errors || b.failed) ? 1 : 0;
+}
 
 int main(int argc, char* argv[])
 {
 	int res;
-	unsigned char buf[256];
+	unsigned char buf[FEATURE_LEN + 1];
 	#define MAX_STR 255
 	wchar_t wstr[MAX_STR];
 	hid_device *handle;
 	int i;
+	int bench_count = 0;
+	int bench_all = 0;
+	int bench_feature = 0;
+	int bench_isr = 0;
 
-#ifdef WIN32
-	UNREFERENCED_PARAMETER(argc);
-	UNREFERENCED_PARAMETER(argv);
-#endif
+	// hidtest [-b count [-m] [-k pairs [-d depth]] [-f] [-i]]: with -b, time
+	// count 0x80/0x81 transactions; with -m as well, on every attached device
+	// at once; with -k, batched that many pairs to a report, with up to depth
+	// reports in flight; with -f, time count feature report round trips
+	// instead; with -i, print the longest isr() seen during the run.
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+			bench_count = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-m")) {
+			bench_all = 1;
+		}
+		else if (!strcmp(argv[i], "-k") && i + 1 < argc) {
+			bench_batch = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+			bench_depth = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-f")) {
+			bench_feature = 1;
+		}
+		else if (!strcmp(argv[i], "-i")) {
+			bench_isr = 1;
+		}
+		else {
+			bench_depth = 0;
+			break;
+		}
+	}
+	if (bench_batch < 0 || bench_batch > BATCH_MAX_PAIRS || bench_depth < 1 || bench_depth > BATCH_MAX_DEPTH) {
+		printf("usage: %s [-b count [-m] [-k pairs (1-%d) [-d depth (1-%d)]] [-f] [-i]]\n",
+			argv[0], BATCH_MAX_PAIRS, BATCH_MAX_DEPTH);
+		return 1;
+	}
 
 	struct hid_device_info *devs, *cur_dev;
 	
@@ -50,7 +489,7 @@ int main(int argc, char* argv[])
 
 	devs = hid_enumerate(0x0, 0x0);
 	cur_dev = devs;	
-	while (cur_dev) {
+	while (cur_dev && !bench_count) {
 		printf("Device Found\n  type: %04hx %04hx\n  path: %s\n  serial_number: %ls", cur_dev->vendor_id, cur_dev->product_id, cur_dev->path, cur_dev->serial_number);
 		printf("\n");
 		printf("  Manufacturer: %ls\n", cur_dev->manufacturer_string);
@@ -62,6 +501,12 @@ int main(int argc, char* argv[])
 	}
 	hid_free_enumeration(devs);
 
+	if (bench_count > 0 && bench_all) {
+		res = benchmark_all(bench_count);
+		hid_exit();
+		return res;
+	}
+
 	// Set up the command buffer.
 	memset(buf,0x00,sizeof(buf));
 	buf[0] = REPORT_NUMBER;
@@ -77,6 +522,18 @@ int main(int argc, char* argv[])
  		return 1;
 	}
 
+	if (bench_count > 0) {
+		// start from a clean slate, so that only this run's worst case is reported
+		if (bench_isr)
+			isr_cycles(handle, 0);
+		res = bench_feature ? benchmark_feature(handle, bench_count) : benchmark(handle, bench_count);
+		if (bench_isr)
+			isr_cycles(handle, 1);
+		hid_close(handle);
+		hid_exit();
+		return res;
+	}
+
 	// Read the Manufacturer String
 	wstr[0] = 0x0000;
 	res = hid_get_manufacturer_string(handle, wstr, MAX_STR);
@@ -113,13 +570,14 @@ int main(int argc, char* argv[])
 	// data here, but execution should not block.
 	res = hid_read(handle, buf, 17);
 
-	// Send a Feature Report to the device
-	buf[0] = 0x2;
+	// Send a Feature Report to the device. The firmware keeps the whole
+	// FEATURE_LEN byte blob, so a short one would not be accepted.
+	buf[0] = REPORT_NUMBER;
 	buf[1] = 0xa0;
 	buf[2] = 0x0a;
 	buf[3] = 0x00;
 	buf[4] = 0x00;
-	res = hid_send_feature_report(handle, buf, 17);
+	res = hid_send_feature_report(handle, buf, FEATURE_LEN + 1);
 	if (res < 0) {
 		printf("Unable to send a feature report.\n");
 	}
@@ -127,7 +585,7 @@ int main(int argc, char* argv[])
 	memset(buf,0,sizeof(buf));
 
 	// Read a Feature Report from the device
-	buf[0] = 0x2;
+	buf[0] = REPORT_NUMBER;
 	res = hid_get_feature_report(handle, buf, sizeof(buf));
 	if (res < 0) {
 		printf("Unable to get a feature report.\n");
@@ -35,27 +35,112 @@
 since this is a downloaded app, configuration words (e.g. __CONFIG or #pragma config) are not relevant
 */
 
+/*
+batched commands; rather than one command per report, an OUT report starting with CMD_BATCH carries several:
+
+OUT: CMD_BATCH, sequence number, then records of { length, command, arguments[length - 1] }
+IN:  CMD_BATCH, the same sequence number, count of commands executed, then records of { length, command, data[length - 1] }
+     for those of the commands that return data, in order
+
+either list of records ends with a zero length or at the end of the report
+execution stops early at a malformed record, or at a command whose data would no longer fit in the IN report;
+the host resends whatever follows the count executed
+the sequence number lets the host match replies to requests with several reports in flight
+*/
+#define CMD_BATCH 0xC0
+
+/* returned by ExecuteCommand() when the data would not fit, and the command was not executed */
+#define NO_ROOM 0xFF
+
+static uint8_t counter;
+
+/*
+optional synthetic application load, in instruction cycles per pass of the main loop,
+for measuring how command latency holds up when the CPU has other work to do
+*/
+//#define APP_LOAD_CYCLES 12000
+
+/*
+optional measurement of the time spent in isr(), in instruction cycles counted by Timer1 at Fosc/4;
+command 0x82 returns the longest since it was last asked (little-endian), and starts afresh
+the few cycles taken by the interrupt itself and the context save, ahead of isr()'s first statement, are not counted
+*/
+//#define ISR_TIMING
+
+#ifdef ISR_TIMING
+#ifndef USB_USE_INTERRUPTS
+#error ISR_TIMING needs USB_USE_INTERRUPTS, as isr() has nothing to do otherwise
+#endif
+static uint16_t isr_cycles_max; /* only touched by main() while USBIE is off */
+#endif
+
+#ifdef USB_USE_INTERRUPTS
+/*
+with USB_USE_INTERRUPTS, EP1 OUT reports are copied into this queue from app_out_transaction_callback() in the ISR,
+and the endpoint re-armed there and then, so the host isn't held up by the main loop; main() works through the queue
+a report arriving while the queue is full is left in the endpoint (NAKing the host) until main() makes room
+the length must be a power of two no larger than 128
+*/
+#define OUT_QUEUE_LEN 4
+static uint8_t out_queue[OUT_QUEUE_LEN][EP_1_OUT_LEN];
+static volatile uint8_t out_queue_head; /* advanced only by the ISR */
+static volatile uint8_t out_queue_tail; /* advanced only by main() */
+
+static void TakeOutReports(void);
+#endif
+
+static bool CommandHasReply(uint8_t command);
+static void ProcessReport(const uint8_t *rx);
+static uint8_t ExecuteCommand(uint8_t command, uint8_t *data, uint8_t room);
+static void ExecuteBatch(const uint8_t *rx, uint8_t *tx);
+
 int main(void)
 {
-	uint8_t *TxDataBuffer;
-	const uint8_t *RxDataBuffer;
-	uint8_t counter = 0;
-
 #ifdef USB_USE_INTERRUPTS
+	const uint8_t *report;
+
+#ifdef ISR_TIMING
+	/* Timer1 counts instruction cycles, and is left stopped between interrupts */
+	T1CON = 0x00;
+#endif
+
 	INTCONbits.PEIE = 1;
 	INTCONbits.GIE = 1;
+#else
+	const uint8_t *RxDataBuffer;
 #endif
 
 	usb_init();
 
-	TxDataBuffer = usb_get_in_buffer(1);
-
 	for (;;)
 	{
-#ifndef USB_USE_INTERRUPTS
-		usb_service();
+#ifdef APP_LOAD_CYCLES
+		_delay(APP_LOAD_CYCLES);
 #endif
 
+#ifdef USB_USE_INTERRUPTS
+		/* everything on the USB side happens in isr(); only the commands themselves are carried out here */
+		if (out_queue_head == out_queue_tail)
+			continue;
+
+		report = out_queue[out_queue_tail & (OUT_QUEUE_LEN - 1)];
+
+		/* the stack isn't re-entrant, so the USB interrupt is held off while EP1 IN is used from here */
+		PIE2bits.USBIE = 0;
+		if (CommandHasReply(report[0]) && (usb_in_endpoint_halted(1) || usb_in_endpoint_busy(1)))
+		{
+			PIE2bits.USBIE = 1;
+			continue;
+		}
+		ProcessReport(report);
+		++out_queue_tail;
+
+		/* a report left in the endpoint for want of room can now be taken */
+		TakeOutReports();
+		PIE2bits.USBIE = 1;
+#else
+		usb_service();
+
 		/* if USB isn't configured, there is no point in proceeding further */
 		if (!usb_is_configured())
 			continue;
@@ -63,6 +148,8 @@ int main(void)
 		/*
 		we check these *BEFORE* calling usb_out_endpoint_has_data() as the documentation indicates this 
 		must be followed usb_arm_out_endpoint() to enable reception of the next transaction
+		EP1 is ping-ponged in both directions, so IN is only busy once both its buffers are waiting for the
+		host, and the SIE keeps receiving into one OUT buffer while the other is processed here
 		*/
 		if (usb_in_endpoint_halted(1) || usb_in_endpoint_busy(1))
 			continue;
@@ -74,47 +161,160 @@ int main(void)
 		/* obtain a pointer to the receive buffer and the length of data contained within it */
 		usb_get_out_buffer(1, &RxDataBuffer);
 
-		/* pre-fill the response with an echo back of the command */
-		TxDataBuffer[0] = RxDataBuffer[0];
+		ProcessReport(RxDataBuffer);
+
+		/* re-arm the endpoint to receive the next EP1 OUT */
+		usb_arm_out_endpoint(1);
+#endif
+	}
+}
+
+#ifdef USB_USE_INTERRUPTS
+/* move EP1 OUT reports into out_queue while there is room, re-arming the endpoint for each; USB interrupts must be off */
+static void TakeOutReports(void)
+{
+	const uint8_t *RxDataBuffer;
+	uint8_t len;
+
+	while (((uint8_t)(out_queue_head - out_queue_tail) < OUT_QUEUE_LEN) && usb_out_endpoint_has_data(1))
+	{
+		len = usb_get_out_buffer(1, &RxDataBuffer);
+		memcpy(out_queue[out_queue_head & (OUT_QUEUE_LEN - 1)], RxDataBuffer, len);
+		++out_queue_head;
+		usb_arm_out_endpoint(1);
+	}
+}
+
+void app_out_transaction_callback(uint8_t endpoint)
+{
+	if (1 == endpoint)
+		TakeOutReports();
+}
+#endif
+
+/* carry out the command(s) in an OUT report; the caller has made sure an IN buffer is free if CommandHasReply() */
+static void ProcessReport(const uint8_t *rx)
+{
+	uint8_t *TxDataBuffer;
+
+	/* the IN buffer to fill alternates with ping-pong, so it is fetched afresh for every reply */
+	TxDataBuffer = usb_get_in_buffer(1);
 
+	/* pre-fill the response with an echo back of the command */
+	TxDataBuffer[0] = rx[0];
+
+	if (CMD_BATCH == rx[0])
+	{
+		/* a batch is always answered, even if none of its commands return data, so the host sees it done */
+		ExecuteBatch(rx, TxDataBuffer);
+		usb_send_in_buffer(1, EP_1_IN_LEN);
+	}
+	else if (ExecuteCommand(rx[0], &TxDataBuffer[1], EP_1_IN_LEN - 1))
+	{
+		/* send a response back to the PC */
+		usb_send_in_buffer(1, EP_1_IN_LEN);
+	}
+}
+
+/* whether a report starting with this command is answered; keep in step with ExecuteCommand() */
+static bool CommandHasReply(uint8_t command)
+{
+#ifdef ISR_TIMING
+	if (0x82 == command)
+		return true;
+#endif
+	return (CMD_BATCH == command) || (0x81 == command);
+}
+
+/*
+execute one command, putting any data it returns in data[]; returns the length of that data
+note to would-be developer: be VERY WARY about using a switch() statement
+the XC8 compiler generates bloated code, particularly if the case values are not all consecutive
+if, else if, else if statements are more efficient with XC8, albeit at the cost of readability
+*/
+static uint8_t ExecuteCommand(uint8_t command, uint8_t *data, uint8_t room)
+{
+	if (0x80 == command)
+	{
 		/*
-		note to would-be developer: be VERY WARY about using a switch() statement
-		the XC8 compiler generates bloated code, particularly if the case values are not all consecutive
-		if, else if, else if statements are more efficient with XC8, albeit at the cost of readability
+		action in response to command would go here
+		as an example, we are incrementing a counter than can be read by command 0x81
 		*/
-		switch (RxDataBuffer[0])
-		{
-
-		case 0x80:
+		counter++;
+	}
+	else if (0x81 == command)
+	{
+		/*
+		response to query command would go here
+		as an example, we are returning the counter value incremented by command 0x80
+		*/
+		if (room < 1)
+			return NO_ROOM;
+		data[0] = counter;
+		return 1;
+	}
+#ifdef ISR_TIMING
+	else if (0x82 == command)
+	{
+		/* the longest isr() so far, in instruction cycles */
+		if (room < 2)
+			return NO_ROOM;
+		data[0] = (uint8_t)isr_cycles_max;
+		data[1] = (uint8_t)(isr_cycles_max >> 8);
+		isr_cycles_max = 0;
+		return 2;
+	}
+#endif
 
-			/*
-			action in response to command would go here
-			as an example, we are incrementing a counter than can be read by command 0x81
-			*/
-			counter++;
+	return 0;
+}
 
-			break;
+/* run the commands of a CMD_BATCH report in rx[], building the reply in tx[] */
+static void ExecuteBatch(const uint8_t *rx, uint8_t *tx)
+{
+	uint8_t in, out, len, done, result;
 
-		case 0x81:
+	tx[1] = rx[1];
+	done = 0;
+	in = 2;
+	out = 3;
 
-			/*
-			response to query command would go here
-			as an example, we are returning the counter value incremented by command 0x80
-			*/
-			TxDataBuffer[1] = counter;
+	while (in < EP_1_OUT_LEN)
+	{
+		len = rx[in];
 
-			/* send a response back to the PC */
-			usb_send_in_buffer(1, EP_1_IN_LEN);
+		/* a zero length ends the batch; a record running past the end of the report is malformed */
+		if ((0 == len) || (len > (uint8_t)(EP_1_OUT_LEN - 1 - in)))
+			break;
 
+		/* a response record has a length and a command byte ahead of the data */
+		result = ExecuteCommand(rx[in + 1], &tx[out + 2], (out < (EP_1_IN_LEN - 2)) ? (EP_1_IN_LEN - 2 - out) : 0);
+		if (NO_ROOM == result)
 			break;
 
+		if (result)
+		{
+			tx[out] = result + 1;
+			tx[out + 1] = rx[in + 1];
+			out += result + 2;
 		}
 
-		/* re-arm the endpoint to receive the next EP1 OUT */
-		usb_arm_out_endpoint(1);
+		in += len + 1;
+		++done;
 	}
+
+	tx[2] = done;
+	if (out < EP_1_IN_LEN)
+		tx[out] = 0;
 }
 
+/*
+the feature report is a FEATURE_REPORT_LEN byte blob kept in RAM, for configuration data too big for one EP1 report;
+Set_Report stores it and Get_Report returns it, each as one control transfer whose data stage spans several EP0 packets
+only one control transfer is active at a time, so both directions can share the one buffer
+*/
+static uint8_t feature_report[FEATURE_REPORT_LEN];
+
 /* Callbacks. These function names are set in usb_config.h. */
 int8_t app_unknown_setup_request_callback(const struct setup_packet *setup)
 {
@@ -126,12 +326,63 @@ int8_t app_unknown_setup_request_callback(const struct setup_packet *setup)
 	 * MULTI_CLASS_DEVICE is defined in usb_config.h and call all
 	 * appropriate device class setup request functions here.
 	 */
+
+	/* the feature report is only ever written whole; app_set_report_callback() can't see wLength, so a
+	   Set_Report of any other length is STALLed here, rather than have its data stage run on past wLength */
+	if ((0x21 == setup->REQUEST.bmRequestType) && (HID_SET_REPORT == setup->bRequest) &&
+	    (HID_FEATURE == (setup->wValue >> 8)) && (FEATURE_REPORT_LEN != setup->wLength))
+		return -1;
+
 	return process_hid_setup_request(setup);
 }
 
+/* HID Callbacks. See usb_hid.h for documentation. */
+
+static void feature_report_callback(bool transfer_ok, void *context)
+{
+	/* nothing to do; if a Set_Report failed part-way, the host is told so and can send the blob again */
+}
+
+int16_t app_get_report_callback(uint8_t interface, uint8_t report_type,
+                                uint8_t report_id, const void **report,
+                                usb_ep0_data_stage_callback *callback,
+                                void **context)
+{
+	/* only the feature report is available through Get_Report; the input report comes on EP1 IN */
+	if (HID_FEATURE != report_type)
+		return -1;
+
+	*report = feature_report;
+	*callback = feature_report_callback;
+	*context = NULL;
+	return sizeof(feature_report);
+}
+
+int8_t app_set_report_callback(uint8_t interface, uint8_t report_type,
+                               uint8_t report_id)
+{
+	if (HID_FEATURE != report_type)
+		return -1;
+
+	/* the stack fills feature_report packet by packet as the data stage arrives; its wLength has been
+	   checked against FEATURE_REPORT_LEN in app_unknown_setup_request_callback() */
+	usb_start_receive_ep0_data_stage((char *)feature_report, sizeof(feature_report), &feature_report_callback, NULL);
+	return 0;
+}
+
 void interrupt isr()
 {
 #ifdef USB_USE_INTERRUPTS
+#ifdef ISR_TIMING
+    TMR1H = 0;
+    TMR1L = 0;
+    T1CONbits.TMR1ON = 1;
+#endif
     usb_service();
+#ifdef ISR_TIMING
+    T1CONbits.TMR1ON = 0;
+    if (TMR1 > isr_cycles_max)
+        isr_cycles_max = TMR1;
+#endif
 #endif
 }
@@ -38,12 +38,16 @@
    activate endpoints EP 1 IN, EP 1 OUT, EP 2 IN, EP 2 OUT.  */
 #define NUM_ENDPOINT_NUMBERS 1
 
-/* Only 8, 16, 32 and 64 are supported for endpoint zero length. */
-#define EP_0_LEN 8
+/* Only 8, 16, 32 and 64 are supported for endpoint zero length.
+   64 keeps the feature report below to a few packets per control transfer. */
+#define EP_0_LEN 64
 
 #define EP_1_OUT_LEN 64
 #define EP_1_IN_LEN  64
 
+/* length of the feature report, moved over EP0 by Set_Report/Get_Report (at most 256) */
+#define FEATURE_REPORT_LEN 256
+
 #define NUMBER_OF_CONFIGURATIONS 1
 
 /* Ping-pong buffering mode. Valid values are:
@@ -53,7 +57,7 @@
 	PPB_EPN_ONLY     - Ping-pong all endpoints except 0
 */
 
-#define PPB_MODE PPB_NONE
+#define PPB_MODE PPB_EPN_ONLY
 
 /* Comment the following line to use polling USB operation. When using polling,
    You are responsible for calling usb_service() periodically from your
@@ -73,7 +77,12 @@
 //#define ENDPOINT_HALT_CALLBACK     app_endpoint_halt_callback
 //#define SET_INTERFACE_CALLBACK     app_set_interface_callback
 //#define GET_INTERFACE_CALLBACK     app_get_interface_callback
+#ifdef USB_USE_INTERRUPTS
+/* with interrupts, main.c takes EP1 OUT reports into its queue as they arrive */
+#define OUT_TRANSACTION_CALLBACK   app_out_transaction_callback
+#else
 //#define OUT_TRANSACTION_CALLBACK   app_out_transaction_callback
+#endif
 //#define IN_TRANSACTION_COMPLETE_CALLBACK   app_in_transaction_complete_callback
 #define UNKNOWN_SETUP_REQUEST_CALLBACK app_unknown_setup_request_callback
 //#define UNKNOWN_GET_DESCRIPTOR_CALLBACK app_unknown_get_descriptor_callback
@@ -86,8 +95,8 @@
 //#define USB_HID_PHYSICAL_DESCRIPTOR_FUNC usb_application_get_hid_physical_descriptor
 
 /* HID Callbacks. See usb_hid.h for documentation. */
-//#define HID_GET_REPORT_CALLBACK app_get_report_callback
-//#define HID_SET_REPORT_CALLBACK app_set_report_callback
+#define HID_GET_REPORT_CALLBACK app_get_report_callback
+#define HID_SET_REPORT_CALLBACK app_set_report_callback
 //#define HID_GET_IDLE_CALLBACK app_get_idle_callback
 //#define HID_SET_IDLE_CALLBACK app_set_idle_callback
 //#define HID_GET_PROTOCOL_CALLBACK app_get_protocol_callback
@@ -81,6 +81,11 @@ static const ROMPTR uint8_t custom_report_descriptor[] =
     0x19, 0x01,             //      Usage Minimum 
     0x29, 0x40,             //      Usage Maximum 	//64 output usages total (0x01 to 0x40)
     0x91, 0x00,             //      Output (Data, Array, Abs): Instantiates output packet fields.  Uses same report size and count as "Input" fields, since nothing new/different was specified to the parser since the "Input" item.
+    0x09, 0x02,             //      Usage (Vendor Usage 2)
+    0x15, 0x00,             //      Logical Minimum (0)
+    0x26, 0xFF, 0x00,       //      Logical Maximum (255)
+    0x96, (FEATURE_REPORT_LEN & 0xFF), (FEATURE_REPORT_LEN >> 8), // Report Count: FEATURE_REPORT_LEN 8-bit fields
+    0xB1, 0x02,             //      Feature (Data, Var, Abs): one FEATURE_REPORT_LEN byte blob, carried over EP0 by Set_Report/Get_Report
     0xC0                    // End Collection
 };
 
@@ -37,13 +37,40 @@ STATIC_SIZE_CHECK_EQUAL(sizeof(struct hid_descriptor), 9);
 STATIC_SIZE_CHECK_EQUAL(sizeof(struct hid_optional_descriptor), 3);
 
 #ifdef MULTI_CLASS_DEVICE
-static uint8_t *hid_interfaces;
-static uint8_t num_hid_interfaces;
+#ifndef HID_MAX_INTERFACES
+#define HID_MAX_INTERFACES 16
+#endif
+
+/* Bitmap of the HID interfaces, built once by hid_set_interface_list() so
+ * that the per-request check is a single lookup rather than a walk of the
+ * interface list. */
+static uint8_t hid_interface_map[(HID_MAX_INTERFACES + 7) / 8];
+static const uint8_t interface_bit[8] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+};
 
 void hid_set_interface_list(uint8_t *interfaces, uint8_t num_interfaces)
 {
-	hid_interfaces = interfaces;
-	num_hid_interfaces = num_interfaces;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(hid_interface_map); i++)
+		hid_interface_map[i] = 0;
+
+	for (i = 0; i < num_interfaces; i++) {
+		uint8_t interface = interfaces[i];
+		if (interface < HID_MAX_INTERFACES)
+			hid_interface_map[interface >> 3] |=
+				interface_bit[interface & 0x7];
+	}
+}
+
+static bool interface_is_hid(uint8_t interface)
+{
+	if (interface >= HID_MAX_INTERFACES)
+		return false;
+
+	return (hid_interface_map[interface >> 3] &
+	        interface_bit[interface & 0x7]) != 0;
 }
 #endif
 
@@ -58,14 +85,7 @@ uint8_t process_hid_setup_request(const struct setup_packet *setup)
 	 * HID interface. Composite devices will need to call
 	 * hid_set_interface_list() first.
 	 */
-	uint8_t i;
-	for (i = 0; i < num_hid_interfaces; i++) {
-		if (interface == hid_interfaces[i])
-			break;
-	}
-
-	/* Return if interface is not in the list of HID interfaces. */
-	if (i == num_hid_interfaces)
+	if (!interface_is_hid(interface))
 		return -1;
 #endif
 
@@ -0,0 +1,50 @@
+/*
+    serial channel interface shared between main.c and the USB callbacks in usb_helpers.c
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CHANNEL_H__
+#define CHANNEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* each channel is a CDC function of two interfaces: comm (even) and data (odd) */
+#define CHANNEL_USART 0 /* interfaces 0 and 1 */
+#define CHANNEL_SPI   1 /* interfaces 2 and 3 */
+#define NUM_CHANNELS  2
+
+#define CHANNEL_FROM_INTERFACE(interface) ((interface) >> 1)
+
+/* the power-up rate of both channels, until the host sends SET_LINE_CODING */
+#define CHANNEL_DEFAULT_BPS 115200UL
+
+/*
+    set the USART baud rate or the SPI clock rate closest to bps;
+    returns the rate actually achieved, or 0 (leaving the channel untouched) if bps is unattainable
+*/
+uint32_t SetChannelRate(uint8_t channel, uint32_t bps);
+
+/* apply the DTR state set by the host; on the SPI channel, DTR drives chip select */
+void SetChannelControlLines(uint8_t channel, bool dtr);
+
+#endif /* CHANNEL_H__ */
@@ -0,0 +1,331 @@
+/*
+    example dual CDC serial port adapter using PIC16F1459 microcontroller
+
+    this is specific to the PIC16F1459; the first port bridges the USART
+    (TX on pin RB7, RX on pin RB5) and the second port bridges the MSSP as
+    an SPI master (SCK on RB6, SDO on RC7, SDI on RB4, /CS on RC6)
+
+    every byte sent to the SPI port is shifted out, and the byte shifted in
+    at the same time is returned to the PC; /CS follows the port's DTR
+
+    based on M-Stack by Alan Ott, Signal 11 Software
+
+    culled from USB CDC-ACM Demo (by Alan Ott, Signal 11 Software)
+    and ANSI C12.18 optical interface (by Peter Lawrence)
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include "usb.h"
+#include <xc.h>
+#include <string.h>
+#include "usb_config.h"
+#include "usb_ch9.h"
+#include "usb_cdc.h"
+#include "channel.h"
+
+/*
+    every channel buffer is carved out of one pool, sized by what that channel needs:
+    the USART needs separate rings for each direction, as the target may talk at any time,
+    but the SPI master can reuse a single ring in place, as each byte shifted in replaces the byte shifted out
+
+    ring lengths must be powers of two no larger than 128, and no smaller than EP_DATA_LEN
+    (OUT data is only accepted when a whole packet is guaranteed to fit)
+
+    the endpoint buffers themselves are not pooled: they stay M-Stack's fixed per-endpoint
+    arrays in USB RAM (see README.TXT)
+*/
+#define USART_RX_LEN 64
+#define USART_TX_LEN 64
+#define SPI_LEN      128
+
+static uint8_t ring_pool[USART_RX_LEN + USART_TX_LEN + SPI_LEN];
+
+struct ring
+{
+	uint8_t *buf;
+	uint8_t mask;
+	volatile uint8_t head; /* bytes are added here */
+	volatile uint8_t tail; /* ... and removed from here */
+};
+
+/* USART RX -> USB IN; head is advanced only by isr(), tail only by main() */
+static struct ring usart_rx = { ring_pool, USART_RX_LEN - 1 };
+/* USB OUT -> USART TX; head is advanced only by main(), tail only by isr() */
+static struct ring usart_tx = { ring_pool + USART_RX_LEN, USART_TX_LEN - 1 };
+
+/*
+    USB OUT -> SPI -> USB IN; head and tail are advanced by main(),
+    and spi_shift by isr() as each byte in [spi_shift, head) is exchanged
+*/
+static struct ring spi = { ring_pool + USART_RX_LEN + USART_TX_LEN, SPI_LEN - 1 };
+static volatile uint8_t spi_shift;
+static volatile bool spi_busy;
+
+static void InitializeUSART(void);
+static void InitializeSPI(void);
+static void SendToPC(uint8_t endpoint, struct ring *ring, uint8_t ready);
+static bool ReceiveFromPC(uint8_t endpoint, struct ring *ring);
+
+int main(void)
+{
+	InitializeUSART();
+	InitializeSPI();
+
+	INTCONbits.PEIE = 1;
+	INTCONbits.GIE = 1;
+
+	usb_init();
+
+	for (;;)
+	{
+#ifndef USB_USE_INTERRUPTS
+		usb_service();
+#endif
+
+		/* if USB isn't configured, there is no point in proceeding further */
+		if (!usb_is_configured())
+			continue;
+
+		/* USART channel */
+		SendToPC(2, &usart_rx, usart_rx.head);
+		if (ReceiveFromPC(2, &usart_tx))
+			PIE1bits.TXIE = 1;
+
+		/* SPI channel; only bytes already exchanged are returned to the PC */
+		SendToPC(4, &spi, spi_shift);
+		ReceiveFromPC(4, &spi);
+		if (!spi_busy && (spi_shift != spi.head))
+		{
+			/* isr() keeps the exchange going until it catches up with head */
+			spi_busy = true;
+			SSP1BUF = spi.buf[spi_shift & spi.mask];
+		}
+	}
+}
+
+/* hand the PC the bytes in [tail, ready), if the IN endpoint is free */
+static void SendToPC(uint8_t endpoint, struct ring *ring, uint8_t ready)
+{
+	uint8_t *in_buf;
+	uint8_t count, i;
+
+	if (usb_in_endpoint_halted(endpoint) || usb_in_endpoint_busy(endpoint))
+		return;
+
+	count = ready - ring->tail;
+
+	/* stay one byte short of a full packet, which would otherwise need a ZLP */
+	if (count > (EP_DATA_LEN - 1))
+		count = EP_DATA_LEN - 1;
+
+	if (0 == count)
+		return;
+
+	in_buf = usb_get_in_buffer(endpoint);
+	for (i = 0; i < count; i++)
+		in_buf[i] = ring->buf[(uint8_t)(ring->tail + i) & ring->mask];
+	usb_send_in_buffer(endpoint, count);
+
+	ring->tail += count;
+}
+
+/* append the next OUT packet to the ring, if a whole packet is sure to fit; returns true if data was added */
+static bool ReceiveFromPC(uint8_t endpoint, struct ring *ring)
+{
+	const uint8_t *out_buf;
+	uint8_t count, i;
+
+	if ((uint8_t)(ring->head - ring->tail) > (uint8_t)(ring->mask + 1 - EP_DATA_LEN))
+		return false;
+
+	/* if we pass this test, we are committed to make the usb_arm_out_endpoint() call */
+	if (!usb_out_endpoint_has_data(endpoint))
+		return false;
+
+	count = usb_get_out_buffer(endpoint, &out_buf);
+	for (i = 0; i < count; i++)
+		ring->buf[(uint8_t)(ring->head + i) & ring->mask] = out_buf[i];
+	ring->head += count;
+
+	usb_arm_out_endpoint(endpoint);
+
+	return (count > 0);
+}
+
+void interrupt isr()
+{
+	uint8_t rx;
+
+	/* USART receive */
+	if (PIR1bits.RCIF)
+	{
+		if (RCSTAbits.OERR)
+		{
+			/* in case of overrun error, reset the port */
+			RCSTAbits.CREN = 0;
+			RCSTAbits.CREN = 1;
+		}
+		rx = RCREG;
+		/* if the ring is full, the byte is discarded */
+		if ((uint8_t)(usart_rx.head - usart_rx.tail) <= usart_rx.mask)
+		{
+			usart_rx.buf[usart_rx.head & usart_rx.mask] = rx;
+			++usart_rx.head;
+		}
+	}
+
+	/* USART transmit; the interrupt is disabled once the ring runs dry */
+	if (PIE1bits.TXIE && PIR1bits.TXIF)
+	{
+		if (usart_tx.head != usart_tx.tail)
+		{
+			TXREG = usart_tx.buf[usart_tx.tail & usart_tx.mask];
+			++usart_tx.tail;
+		}
+		else
+		{
+			PIE1bits.TXIE = 0;
+		}
+	}
+
+	/* SPI exchange complete; store the byte shifted in over the one shifted out, and start the next */
+	if (PIR1bits.SSP1IF)
+	{
+		PIR1bits.SSP1IF = 0;
+		spi.buf[spi_shift & spi.mask] = SSP1BUF;
+		++spi_shift;
+		if (spi_shift != spi.head)
+			SSP1BUF = spi.buf[spi_shift & spi.mask];
+		else
+			spi_busy = false;
+	}
+
+#ifdef USB_USE_INTERRUPTS
+	usb_service();
+#endif
+}
+
+static void InitializeUSART(void)
+{
+	/* RX on RB5 is a digital input */
+	ANSELBbits.ANSB5 = 0;
+	TRISBbits.TRISB5 = 1;
+
+	/* TX on RB7 is an output */
+	TRISBbits.TRISB7 = 0;
+
+	TXSTA = 0x24;
+	RCSTA = 0x90;
+
+	/* BRG16 */
+	BAUDCON = 0x08;
+
+	SetChannelRate(CHANNEL_USART, CHANNEL_DEFAULT_BPS);
+
+	/* clear any data in receive buffer */
+	(volatile void)RCREG;
+
+	/* receive is interrupt-driven; transmit interrupts are enabled on demand by main() */
+	PIE1bits.TXIE = 0;
+	PIE1bits.RCIE = 1;
+}
+
+static void InitializeSPI(void)
+{
+	/* /CS on RC6 is an output, deasserted until the host raises DTR */
+	ANSELCbits.ANSC6 = 0;
+	LATCbits.LATC6 = 1;
+	TRISCbits.TRISC6 = 0;
+
+	/* SDO on RC7 and SCK on RB6 are outputs */
+	ANSELCbits.ANSC7 = 0;
+	TRISCbits.TRISC7 = 0;
+	TRISBbits.TRISB6 = 0;
+
+	/* SDI on RB4 is a digital input */
+	ANSELBbits.ANSB4 = 0;
+	TRISBbits.TRISB4 = 1;
+
+	/* SPI mode 0: sample in the middle, transmit on the active-to-idle clock edge */
+	SSP1STAT = 0x40;
+
+	SetChannelRate(CHANNEL_SPI, CHANNEL_DEFAULT_BPS);
+
+	/* enabled as master, clocked from Fosc / (4 * (SSP1ADD + 1)), idle low */
+	SSP1CON1 = 0x2A;
+
+	PIR1bits.SSP1IF = 0;
+	PIE1bits.SSP1IE = 1;
+}
+
+/* both channels are clocked from the 48 MHz system clock */
+#define CHANNEL_FOSC 48000000UL
+
+uint32_t SetChannelRate(uint8_t channel, uint32_t bps)
+{
+	uint32_t divisor;
+	uint8_t prescale;
+
+	if (CHANNEL_SPI == channel)
+	{
+		/* SSP1ADD values below 3 are not supported in SPI mode, so 3 MHz down to 46875 Hz */
+		if ( (bps > (CHANNEL_FOSC / 16)) || (bps < (CHANNEL_FOSC / 1024)) )
+			return 0;
+
+		divisor = (CHANNEL_FOSC / 4 + bps / 2) / bps;
+		if (divisor > 256)
+			divisor = 256;
+		SSP1ADD = (uint8_t)(divisor - 1);
+
+		return CHANNEL_FOSC / 4 / divisor;
+	}
+
+	/* with BRGH set, the rate is Fosc / (4 * (SPBRG + 1)): 12 Mbps down to 183 bps */
+	prescale = 4;
+	if (bps > (CHANNEL_FOSC / 4))
+		return 0;
+	if (bps < (CHANNEL_FOSC / 4 / 65536UL))
+	{
+		/* with BRGH clear, the rate is Fosc / (16 * (SPBRG + 1)), reaching down to 46 bps */
+		prescale = 16;
+		if (bps < (CHANNEL_FOSC / 16 / 65536UL))
+			return 0;
+	}
+
+	/* round to the nearest divisor */
+	divisor = (CHANNEL_FOSC / prescale + bps / 2) / bps;
+	if (divisor > 65536UL)
+		divisor = 65536UL;
+
+	TXSTAbits.BRGH = (4 == prescale);
+	SPBRGH = (uint8_t)((divisor - 1) >> 8);
+	SPBRG  = (uint8_t)(divisor - 1);
+
+	return CHANNEL_FOSC / prescale / divisor;
+}
+
+void SetChannelControlLines(uint8_t channel, bool dtr)
+{
+	/* /CS is active low */
+	if (CHANNEL_SPI == channel)
+		LATCbits.LATC6 = dtr ? 0 : 1;
+}
@@ -0,0 +1,336 @@
+/*
+    example dual CDC serial port adapter (USART and SPI) using PIC16F1459 microcontroller
+
+    based on M-Stack by Alan Ott, Signal 11 Software
+
+    culled from USB CDC-ACM Demo (by Alan Ott, Signal 11 Software)
+    and ANSI C12.18 optical interface (by Peter Lawrence)
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include "usb_config.h"
+#include "usb.h"
+#include "usb_ch9.h"
+#include "usb_cdc.h"
+
+#ifdef __C18
+#define ROMPTR rom
+#else
+#define ROMPTR
+#endif
+
+struct configuration_1_packet
+{
+	struct configuration_descriptor  config;
+
+	/* USART Port */
+	struct interface_association_descriptor usart_iad;
+	struct interface_descriptor      usart_class_interface;
+	struct cdc_functional_descriptor_header usart_func_header;
+	struct cdc_acm_functional_descriptor usart_acm;
+	struct cdc_union_functional_descriptor usart_union;
+	struct cdc_union_functional_descriptor usart_mgt;
+	struct endpoint_descriptor       usart_ep;
+	struct interface_descriptor      usart_data_interface;
+	struct endpoint_descriptor       usart_data_ep_out;
+	struct endpoint_descriptor       usart_data_ep_in;
+
+	/* SPI Port */
+	struct interface_association_descriptor spi_iad;
+	struct interface_descriptor      spi_class_interface;
+	struct cdc_functional_descriptor_header spi_func_header;
+	struct cdc_acm_functional_descriptor spi_acm;
+	struct cdc_union_functional_descriptor spi_union;
+	struct cdc_union_functional_descriptor spi_mgt;
+	struct endpoint_descriptor       spi_ep;
+	struct interface_descriptor      spi_data_interface;
+	struct endpoint_descriptor       spi_data_ep_out;
+	struct endpoint_descriptor       spi_data_ep_in;
+};
+
+
+const ROMPTR struct device_descriptor this_device_descriptor =
+{
+	sizeof(struct device_descriptor), // bLength
+	DESC_DEVICE, // bDescriptorType
+	0x0200, // 0x0200 = USB 2.0, 0x0110 = USB 1.1
+	DEVICE_CLASS_MISC, /* Device class: composite with Interface Association Descriptors */
+	0x02, /* Device Subclass: common class */
+	0x01, /* Protocol: Interface Association Descriptor */
+	EP_0_LEN, // bMaxPacketSize0
+	0x04D8, // Vendor
+	0x000B, // Product (minimalCDC is 0x000A)
+	0x0100, // device release (1.0)
+	0, // Manufacturer
+	0, // Product
+	0, // Serial
+	NUMBER_OF_CONFIGURATIONS // NumConfigurations
+};
+
+static const ROMPTR struct configuration_1_packet configuration_1 =
+{
+	{
+	// Members from struct configuration_descriptor
+	sizeof(struct configuration_descriptor),
+	DESC_CONFIGURATION,
+	sizeof(configuration_1), // wTotalLength (length of the whole packet)
+	4, // bNumInterfaces
+	1, // bConfigurationValue
+	0, // iConfiguration (index of string descriptor)
+	0b10000000,
+	100/2,   // 100/2 indicates 100mA
+	},
+
+	/* USART Port: Interface Association */
+	{
+	sizeof(struct interface_association_descriptor),
+	DESC_INTERFACE_ASSOCIATION,
+	0, /* bFirstInterface */
+	2, /* bInterfaceCount */
+	CDC_COMMUNICATION_INTERFACE_CLASS, /* bFunctionClass */
+	CDC_COMMUNICATION_INTERFACE_CLASS_ACM_SUBCLASS, /* bFunctionSubClass */
+	0x00, /* bFunctionProtocol */
+	0, /* iFunction */
+	},
+
+	/* USART Port: CDC Class Interface */
+	{
+	// Members from struct interface_descriptor
+	sizeof(struct interface_descriptor), // bLength;
+	DESC_INTERFACE,
+	0x0, // InterfaceNumber
+	0x0, // AlternateSetting
+	0x1, // bNumEndpoints
+	CDC_COMMUNICATION_INTERFACE_CLASS, // bInterfaceClass
+	CDC_COMMUNICATION_INTERFACE_CLASS_ACM_SUBCLASS, // bInterfaceSubclass
+	0x00, // bInterfaceProtocol
+	0, // iInterface (index of string describing interface)
+	},
+
+	/* USART Port: CDC Functional Descriptor Header */
+	{
+	sizeof(struct cdc_functional_descriptor_header),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_HEADER,
+	0x0110, /* bcdCDC (version in BCD) */
+	},
+
+	/* USART Port: CDC ACM Functional Descriptor */
+	{
+	sizeof(struct cdc_acm_functional_descriptor),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_ACM,
+	0, /* bmCapabilities: see minimalCDC for why this is zero */
+	},
+
+	/* USART Port: CDC Union Functional Descriptor */
+	{
+	sizeof (struct cdc_union_functional_descriptor),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_UNION,
+	0, /* bMasterInterface: comm */
+	1, /* bSlaveInterface0: data */
+	},
+
+	/* USART Port: CDC Management Functional Descriptor */
+	{
+	sizeof (struct cdc_union_functional_descriptor),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_MGT,
+	0, /* bMasterInterface: comm */
+	1, /* bSlaveInterface0: data */
+	},
+
+	/* USART Port: CDC ACM Notification Endpoint (Endpoint 1 IN) */
+	{
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	0x01 | 0x80, // endpoint #1 0x80=IN
+	EP_INTERRUPT, // bmAttributes
+	EP_1_IN_LEN, // wMaxPacketSize
+	1, // bInterval in ms.
+	},
+
+	/* USART Port: CDC Data Interface */
+	{
+	// Members from struct interface_descriptor
+	sizeof(struct interface_descriptor), // bLength;
+	DESC_INTERFACE,
+	0x1, // InterfaceNumber
+	0x0, // AlternateSetting
+	0x2, // bNumEndpoints
+	CDC_DATA_INTERFACE_CLASS, // bInterfaceClass
+	0, // bInterfaceSubclass (no subclass)
+	CDC_DATA_INTERFACE_CLASS_PROTOCOL_NONE, // bInterfaceProtocol
+	0, // iInterface (index of string describing interface)
+	},
+
+	/* USART Port: CDC Data OUT Endpoint */
+	{
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	0x02, // endpoint #2 0x00=OUT
+	EP_BULK, // bmAttributes
+	EP_2_OUT_LEN, // wMaxPacketSize
+	0, // bInterval in ms.
+	},
+
+	/* USART Port: CDC Data IN Endpoint */
+	{
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	0x02 | 0x80, // endpoint #2 0x80=IN
+	EP_BULK, // bmAttributes
+	EP_2_IN_LEN, // wMaxPacketSize
+	0, // bInterval in ms.
+	},
+
+	/* SPI Port: Interface Association */
+	{
+	sizeof(struct interface_association_descriptor),
+	DESC_INTERFACE_ASSOCIATION,
+	2, /* bFirstInterface */
+	2, /* bInterfaceCount */
+	CDC_COMMUNICATION_INTERFACE_CLASS, /* bFunctionClass */
+	CDC_COMMUNICATION_INTERFACE_CLASS_ACM_SUBCLASS, /* bFunctionSubClass */
+	0x00, /* bFunctionProtocol */
+	0, /* iFunction */
+	},
+
+	/* SPI Port: CDC Class Interface */
+	{
+	// Members from struct interface_descriptor
+	sizeof(struct interface_descriptor), // bLength;
+	DESC_INTERFACE,
+	0x2, // InterfaceNumber
+	0x0, // AlternateSetting
+	0x1, // bNumEndpoints
+	CDC_COMMUNICATION_INTERFACE_CLASS, // bInterfaceClass
+	CDC_COMMUNICATION_INTERFACE_CLASS_ACM_SUBCLASS, // bInterfaceSubclass
+	0x00, // bInterfaceProtocol
+	0, // iInterface (index of string describing interface)
+	},
+
+	/* SPI Port: CDC Functional Descriptor Header */
+	{
+	sizeof(struct cdc_functional_descriptor_header),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_HEADER,
+	0x0110, /* bcdCDC (version in BCD) */
+	},
+
+	/* SPI Port: CDC ACM Functional Descriptor */
+	{
+	sizeof(struct cdc_acm_functional_descriptor),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_ACM,
+	0, /* bmCapabilities: see minimalCDC for why this is zero */
+	},
+
+	/* SPI Port: CDC Union Functional Descriptor */
+	{
+	sizeof (struct cdc_union_functional_descriptor),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_UNION,
+	2, /* bMasterInterface: comm */
+	3, /* bSlaveInterface0: data */
+	},
+
+	/* SPI Port: CDC Management Functional Descriptor */
+	{
+	sizeof (struct cdc_union_functional_descriptor),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_MGT,
+	2, /* bMasterInterface: comm */
+	3, /* bSlaveInterface0: data */
+	},
+
+	/* SPI Port: CDC ACM Notification Endpoint (Endpoint 3 IN) */
+	{
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	0x03 | 0x80, // endpoint #3 0x80=IN
+	EP_INTERRUPT, // bmAttributes
+	EP_3_IN_LEN, // wMaxPacketSize
+	1, // bInterval in ms.
+	},
+
+	/* SPI Port: CDC Data Interface */
+	{
+	// Members from struct interface_descriptor
+	sizeof(struct interface_descriptor), // bLength;
+	DESC_INTERFACE,
+	0x3, // InterfaceNumber
+	0x0, // AlternateSetting
+	0x2, // bNumEndpoints
+	CDC_DATA_INTERFACE_CLASS, // bInterfaceClass
+	0, // bInterfaceSubclass (no subclass)
+	CDC_DATA_INTERFACE_CLASS_PROTOCOL_NONE, // bInterfaceProtocol
+	0, // iInterface (index of string describing interface)
+	},
+
+	/* SPI Port: CDC Data OUT Endpoint */
+	{
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	0x04, // endpoint #4 0x00=OUT
+	EP_BULK, // bmAttributes
+	EP_4_OUT_LEN, // wMaxPacketSize
+	0, // bInterval in ms.
+	},
+
+	/* SPI Port: CDC Data IN Endpoint */
+	{
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	0x04 | 0x80, // endpoint #4 0x80=IN
+	EP_BULK, // bmAttributes
+	EP_4_IN_LEN, // wMaxPacketSize
+	0, // bInterval in ms.
+	},
+};
+
+static const ROMPTR struct { uint8_t bLength; uint8_t bDescriptorType; uint16_t lang; } str00 =
+{
+	sizeof(str00),
+	DESC_STRING,
+	0x0409 // US English
+};
+
+int16_t usb_application_get_string(uint8_t string_number, const void **ptr)
+{
+	if (0 == string_number)
+	{
+		*ptr = &str00;
+		return sizeof(str00);
+	}
+
+	return -1;
+}
+
+const struct configuration_descriptor *usb_application_config_descs[] =
+{
+	(struct configuration_descriptor*) &configuration_1,
+};
+
+STATIC_SIZE_CHECK_EQUAL(USB_ARRAYLEN(USB_CONFIG_DESCRIPTOR_MAP), NUMBER_OF_CONFIGURATIONS);
+STATIC_SIZE_CHECK_EQUAL(sizeof(USB_DEVICE_DESCRIPTOR), 18);
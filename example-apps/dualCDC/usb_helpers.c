@@ -0,0 +1,159 @@
+#include "usb.h"
+#include <xc.h>
+#include <string.h>
+#include "usb_config.h"
+#include "usb_ch9.h"
+#include "usb_cdc.h"
+#include "channel.h"
+
+/* line coding of each channel as last accepted from the host; only the rate is applied */
+static struct cdc_line_coding line_coding[NUM_CHANNELS] =
+{
+	{ CHANNEL_DEFAULT_BPS, CDC_CHAR_FORMAT_1_STOP_BIT, CDC_PARITY_NONE, 8, },
+	{ CHANNEL_DEFAULT_BPS, CDC_CHAR_FORMAT_1_STOP_BIT, CDC_PARITY_NONE, 8, },
+};
+
+/* Callbacks. These function names are set in usb_config.h. */
+void app_set_configuration_callback(uint8_t configuration)
+{
+
+}
+
+uint16_t app_get_device_status_callback()
+{
+	return 0x0000;
+}
+
+void app_endpoint_halt_callback(uint8_t endpoint, bool halted)
+{
+
+}
+
+int8_t app_set_interface_callback(uint8_t interface, uint8_t alt_setting)
+{
+	return 0;
+}
+
+int8_t app_get_interface_callback(uint8_t interface)
+{
+	return 0;
+}
+
+void app_out_transaction_callback(uint8_t endpoint)
+{
+
+}
+
+void app_in_transaction_complete_callback(uint8_t endpoint)
+{
+
+}
+
+int8_t app_unknown_setup_request_callback(const struct setup_packet *setup)
+{
+	/* To use the CDC device class, have a handler for unknown setup
+	 * requests and call process_cdc_setup_request() (as shown here),
+	 * which will check if the setup request is CDC-related, and will
+	 * call the CDC application callbacks defined in usb_cdc.h. For
+	 * composite devices containing other device classes, make sure
+	 * MULTI_CLASS_DEVICE is defined in usb_config.h and call all
+	 * appropriate device class setup request functions here.
+	 */
+	return process_cdc_setup_request(setup);
+}
+
+int16_t app_unknown_get_descriptor_callback(const struct setup_packet *pkt, const void **descriptor)
+{
+	return -1;
+}
+
+void app_start_of_frame_callback(void)
+{
+
+}
+
+void app_usb_reset_callback(void)
+{
+
+}
+
+/* CDC Callbacks. See usb_cdc.h for documentation. */
+
+int8_t app_send_encapsulated_command(uint8_t interface, uint16_t length)
+{
+	return -1;
+}
+
+int16_t app_get_encapsulated_response(uint8_t interface,
+                                      uint16_t length, const void **report,
+                                      usb_ep0_data_stage_callback *callback,
+                                      void **context)
+{
+	return -1;
+}
+
+void app_set_comm_feature_callback(uint8_t interface,
+                                     bool idle_setting,
+                                     bool data_multiplexed_state)
+{
+
+}
+
+void app_clear_comm_feature_callback(uint8_t interface,
+                                       bool idle_setting,
+                                       bool data_multiplexed_state)
+{
+
+}
+
+int8_t app_get_comm_feature_callback(uint8_t interface,
+                                     bool *idle_setting,
+                                     bool *data_multiplexed_state)
+{
+	return -1;
+}
+
+void app_set_line_coding_callback(uint8_t interface,
+                                    const struct cdc_line_coding *coding)
+{
+	uint8_t channel = CHANNEL_FROM_INTERFACE(interface);
+
+	if (channel >= NUM_CHANNELS)
+		return;
+
+	/* a rate the channel can't reach leaves the previous one in effect */
+	if (0 == SetChannelRate(channel, coding->dwDTERate))
+		return;
+
+	line_coding[channel].dwDTERate = coding->dwDTERate;
+}
+
+int8_t app_get_line_coding_callback(uint8_t interface,
+                                    struct cdc_line_coding *coding)
+{
+	uint8_t channel = CHANNEL_FROM_INTERFACE(interface);
+
+	if (channel >= NUM_CHANNELS)
+		return -1;
+
+	/* report the rate in effect, along with 8N1 framing */
+	*coding = line_coding[channel];
+	return 0;
+}
+
+int8_t app_set_control_line_state_callback(uint8_t interface,
+                                           bool dtr, bool dts)
+{
+	uint8_t channel = CHANNEL_FROM_INTERFACE(interface);
+
+	if (channel >= NUM_CHANNELS)
+		return -1;
+
+	SetChannelControlLines(channel, dtr);
+	return 0;
+}
+
+int8_t app_send_break_callback(uint8_t interface, uint16_t duration)
+{
+	return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ *  M-Stack Automatic WinUSB Support
+ *  Copyright (C) 2013 Alan Ott <alan@signal11.us>
+ *  Copyright (C) 2013 Signal 11 Software
+ *
+ *  2013-10-12
+ *
+ *  M-Stack is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by the
+ *  Free Software Foundation, version 3; or the Apache License, version 2.0
+ *  as published by the Apache Software Foundation.  If you have purchased a
+ *  commercial license for this software from Signal 11 Software, your
+ *  commerical license superceeds the information in this header.
+ *
+ *  M-Stack is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  You should have received a copy of the Apache License, verion 2.0 along
+ *  with this software.  If not, see <http://www.apache.org/licenses/>.
+ */
+
+#ifndef USB_WINUSB_H__
+#define USB_WINUSB_H__
+
+#include <stdint.h>
+
+/* Functions for automatic WinUSB support */
+
+uint16_t m_stack_winusb_get_microsoft_compat(uint8_t interface,
+                                              const void **descriptor);
+
+uint16_t m_stack_winusb_get_microsoft_property(uint8_t interface,
+                                                const void **descriptor);
+
+#endif /* USB_WINUSB_H__ */
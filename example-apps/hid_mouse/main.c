@@ -21,7 +21,11 @@
  */
 
 #include "usb.h"
+#ifdef MOUSESIM
+#include "mousesim.h"
+#else
 #include <xc.h>
+#endif
 #include <string.h>
 #include "usb_config.h"
 #include "usb_ch9.h"
@@ -36,6 +40,36 @@
 static uint8_t hid_interfaces[] = { 0 };
 #endif
 
+/* Mouse movement. Every MOVE_FRAMES frames the pointer moves one count,
+ * MOVE_COUNT times in one direction and then MOVE_COUNT times back. */
+#define MOVE_FRAMES 7
+#define MOVE_COUNT 100
+
+static uint8_t move_delay = MOVE_FRAMES;
+static uint8_t move_count = MOVE_COUNT;
+static int8_t move_direc = 1;
+
+/* Movement not yet reported, and the buttons as last reported. */
+static int8_t pending_x;
+static uint8_t last_buttons;
+
+/* Idle rate as set by the host with Set_Idle, in units of 4 ms; 0 (the
+ * default for a mouse) means never send a report that hasn't changed. */
+static uint8_t idle_rate;
+
+/* Milliseconds since the last report was sent. */
+static uint16_t idle_ms;
+
+/* Counters showing the bus utilization saved by only reporting changes.
+ * Before, a report went out in every frame; now, frame_count -
+ * report_count frames get a NAK in place of a report. idle_report_count
+ * is how many of the reports sent had nothing new in them, and were
+ * only sent because the idle period expired. Read these with a
+ * debugger. */
+static uint32_t frame_count;
+static uint32_t report_count;
+static uint32_t idle_report_count;
+
 int main(void)
 {
 /*
@@ -60,43 +94,13 @@ int main(void)
 #endif
 	usb_init();
 
-	/* Setup mouse movement. This implementation sends back data for every
-	 * IN packet, but sends no movement for all but every delay-th frame.
-	 * Adjusting delay will slow down or speed up the movement, which is
-	 * also dependent upon the rate at which the host sends IN packets,
-	 * which varies between implementations.
-	 *
-	 * In real life, you wouldn't want to send back data that hadn't
-	 * changed, but since there's no real hardware to poll, and since this
-	 * example is about showing the HID class, and not about creative ways
-	 * to do timing, we send back data every frame. The interested reader
-	 * may want to modify it to use the start-of-frame callback for
-	 * timing.
-	 */
-	uint8_t x_count = 100;
-	uint8_t delay = 7;
-	int8_t x_direc = 1;
-
+	/* The mouse is run from the start-of-frame callback, once per 1 ms
+	 * frame, which moves the pointer and sends a report only when there
+	 * is something new to report, or when the host's idle period has
+	 * expired (see app_start_of_frame_callback()). Frames without a
+	 * report cost the bus a NAK rather than a 3-byte data packet and its
+	 * handshake. */
 	while (1) {
-		if (usb_is_configured() &&
-		    !usb_in_endpoint_halted(1) &&
-		    !usb_in_endpoint_busy(1)) {
-
-			unsigned char *buf = usb_get_in_buffer(1);
-			buf[0] = 0x0;
-			buf[1] = (--delay)? 0: x_direc;
-			buf[2] = 0;
-			usb_send_in_buffer(1, 3);
-
-			if (delay == 0) {
-				if (--x_count == 0) {
-					x_count = 100;
-					x_direc *= -1;
-				}
-				delay = 7;
-			}
-		}
-
 		#ifndef USB_USE_INTERRUPTS
 		usb_service();
 		#endif
@@ -161,7 +165,51 @@ int16_t app_unknown_get_descriptor_callback(const struct setup_packet *pkt, cons
 
 void app_start_of_frame_callback(void)
 {
+	uint8_t buttons = 0; /* No buttons to press on this mouse. */
+	bool changed, idle_expired;
+
+	if (!usb_is_configured())
+		return;
+
+	frame_count++;
+
+	/* Move the pointer. */
+	if (--move_delay == 0) {
+		move_delay = MOVE_FRAMES;
+		if (move_direc > 0 ? pending_x < 127 : pending_x > -127)
+			pending_x += move_direc;
+		if (--move_count == 0) {
+			move_count = MOVE_COUNT;
+			move_direc *= -1;
+		}
+	}
 
+	if (idle_ms != 0xffff)
+		idle_ms++;
+
+	/* Movement is relative, so any is a change; buttons are absolute,
+	 * so they're a change only if they differ from the last report. */
+	changed = pending_x != 0 || buttons != last_buttons;
+	idle_expired = idle_rate && idle_ms >= idle_rate * 4u;
+	if (!changed && !idle_expired)
+		return;
+
+	/* Anything not sent now is sent when the endpoint is next free. */
+	if (usb_in_endpoint_halted(1) || usb_in_endpoint_busy(1))
+		return;
+
+	unsigned char *buf = usb_get_in_buffer(1);
+	buf[0] = buttons;
+	buf[1] = pending_x;
+	buf[2] = 0;
+	usb_send_in_buffer(1, 3);
+
+	pending_x = 0;
+	last_buttons = buttons;
+	idle_ms = 0;
+	report_count++;
+	if (!changed)
+		idle_report_count++;
 }
 
 void app_usb_reset_callback(void)
@@ -211,13 +259,20 @@ int8_t app_set_report_callback(uint8_t interface, uint8_t report_type,
 
 uint8_t app_get_idle_callback(uint8_t interface, uint8_t report_id)
 {
-	return 0;
+	return idle_rate;
 }
 
 int8_t app_set_idle_callback(uint8_t interface, uint8_t report_id,
-                             uint8_t idle_rate)
+                             uint8_t rate)
 {
-	return -1;
+	/* This device doesn't use report IDs, so there is only report 0
+	 * (which also means all reports). The new rate counts from the
+	 * last report sent. */
+	if (report_id != 0)
+		return -1;
+
+	idle_rate = rate;
+	return 0;
 }
 
 int8_t app_get_protocol_callback(uint8_t interface)
@@ -0,0 +1,185 @@
+/*
+ * Host-side check of the mouse's report scheduling
+ *
+ * main.c is built for the PC (with -DMOUSESIM; see mousesim.h) and
+ * included here, so that its counters can be read. Its main() isn't run:
+ * with USB_USE_INTERRUPTS, M-Stack calls app_start_of_frame_callback()
+ * from the ISR on every start of frame, and here a loop does the same,
+ * one 1 ms frame at a time, against stubs of the USB calls it makes. In
+ * each frame, the host first takes the queued IN report, if it polls EP1
+ * in that frame, as it does every frame (bInterval is 1 ms) or only every
+ * few frames, as on a busy bus.
+ *
+ * For idle rates 0 (the default for a mouse) and 1 (4 ms), and for each
+ * host polling period, it checks that:
+ *  - the movement reported, plus any on its way to the host and any
+ *    still pending in main.c, is where the pointer has moved to
+ *  - no report without movement is sent at idle rate 0, and none is
+ *    sent sooner than the idle period after the last one otherwise
+ *  - with the host polling every frame, the counts are as expected: a
+ *    move every MOVE_FRAMES frames gives one report each, and at idle
+ *    rate 1 an idle report comes 4 ms after each of those
+ *
+ *   gcc -O2 -Wall -D__XC8 -DMOUSESIM -I. -Iinclude -o mousesim mousesim.c
+ *   ./mousesim
+ *
+ * This file may be used by anyone for any purpose.
+ */
+
+#include <stdio.h>
+
+#include "main.c"
+
+/* only main.c's main() is renamed */
+#undef main
+
+#define FRAMES			14000
+
+static struct
+{
+	unsigned host_period;
+	unsigned long frames;
+
+	/* the IN report waiting for the host, and what the host has made of those it took */
+	uint8_t in_buf[EP_1_IN_LEN];
+	bool in_queued;
+	long sent_x;
+
+	/* where the pointer has been moved to, and when the last report was sent */
+	long moved_x;
+	unsigned long last_report;
+	unsigned long reports, empty, early, errors;
+} sim;
+
+/* the M-Stack calls main.c makes */
+
+void usb_init(void)
+{
+}
+
+uint8_t usb_get_configuration(void)
+{
+	return 1;
+}
+
+unsigned char *usb_get_in_buffer(uint8_t endpoint)
+{
+	(void)endpoint;
+	return sim.in_buf;
+}
+
+void usb_send_in_buffer(uint8_t endpoint, size_t len)
+{
+	(void)endpoint;
+	(void)len;
+
+	if (!sim.in_buf[1])
+		sim.empty++;
+	/* the first report may go out at any time */
+	if (sim.reports && idle_rate && !sim.in_buf[1] && (sim.frames - sim.last_report < idle_rate * 4u))
+		sim.early++;
+	sim.last_report = sim.frames;
+	sim.reports++;
+	sim.in_queued = true;
+}
+
+bool usb_in_endpoint_busy(uint8_t endpoint)
+{
+	(void)endpoint;
+	return sim.in_queued;
+}
+
+bool usb_in_endpoint_halted(uint8_t endpoint)
+{
+	(void)endpoint;
+	return false;
+}
+
+uint8_t process_hid_setup_request(const struct setup_packet *setup)
+{
+	(void)setup;
+	return -1;
+}
+
+/* one frame: the host may take the queued report, and then the stack calls main.c on SOF */
+static void frame(void)
+{
+	long x;
+
+	sim.frames++;
+
+	if (sim.in_queued && (0 == sim.frames % sim.host_period))
+	{
+		sim.sent_x += (int8_t)sim.in_buf[1];
+		sim.in_queued = false;
+	}
+
+	/* main.c moves the pointer one count every MOVE_FRAMES frames, MOVE_COUNT times each way */
+	if (0 == sim.frames % MOVE_FRAMES)
+		sim.moved_x += ((sim.frames / MOVE_FRAMES - 1) / MOVE_COUNT) % 2 ? -1 : 1;
+
+	app_start_of_frame_callback();
+
+	x = sim.sent_x + pending_x;
+	if (sim.in_queued)
+		x += (int8_t)sim.in_buf[1];
+	if (x != sim.moved_x)
+	{
+		if (sim.errors++ < 5)
+			printf("     frame %lu: reported %ld, pointer moved to %ld\n", sim.frames, x, sim.moved_x);
+	}
+}
+
+static int run(uint8_t rate, unsigned host_period)
+{
+	unsigned long expected = 0;
+	bool ok;
+
+	memset(&sim, 0, sizeof(sim));
+	sim.host_period = host_period;
+	move_delay = MOVE_FRAMES;
+	move_count = MOVE_COUNT;
+	move_direc = 1;
+	pending_x = 0;
+	last_buttons = 0;
+	idle_ms = 0;
+	frame_count = report_count = idle_report_count = 0;
+
+	usb_init();
+	app_set_idle_callback(0, 0, rate);
+
+	while (sim.frames < FRAMES)
+		frame();
+
+	ok = !sim.errors && !sim.early && (report_count == sim.reports) && (frame_count == FRAMES);
+	if (0 == rate)
+		ok = ok && !sim.empty;
+	if (1 == host_period)
+	{
+		/* a report for every move, and at idle rate 1 one more in each MOVE_FRAMES frames */
+		expected = FRAMES / MOVE_FRAMES;
+		if (rate)
+			expected *= 2;
+		ok = ok && (report_count == expected) && (idle_report_count == expected - FRAMES / MOVE_FRAMES);
+	}
+
+	printf("%s idle rate %u, host polls every %2u frame(s): %lu frames, %lu reports (%lu idle), %lu frames without one, %lu frames wrong\n",
+		ok ? "ok  " : "FAIL", rate, host_period, (unsigned long)frame_count, (unsigned long)report_count,
+		(unsigned long)idle_report_count, (unsigned long)(frame_count - report_count), sim.errors);
+
+	return ok ? 0 : 1;
+}
+
+int main(void)
+{
+	static const uint8_t rates[] = { 0, 1 };
+	static const unsigned host_periods[] = { 1, 4, 16, 64 };
+	unsigned i, j;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(rates); i++)
+		for (j = 0; j < sizeof(host_periods) / sizeof(host_periods[0]); j++)
+			failures += run(rates[i], host_periods[j]);
+
+	return failures ? 1 : 0;
+}
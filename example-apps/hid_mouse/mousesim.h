@@ -0,0 +1,16 @@
+/*
+ * Host build of main.c, for mousesim.c
+ *
+ * This stands in for <xc.h> when main.c is built with -DMOUSESIM. None
+ * of the PIC-specific code is built then, and mousesim.c has the real
+ * main().
+ *
+ * This file may be used by anyone for any purpose.
+ */
+
+#ifndef MOUSESIM_H__
+#define MOUSESIM_H__
+
+#define main hid_mouse_main
+
+#endif /* MOUSESIM_H__ */
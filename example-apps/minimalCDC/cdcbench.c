@@ -0,0 +1,532 @@
+/*
+    PC-side throughput and latency benchmark for the minimalCDC serial port adapter
+
+    with one port, the target's TX must be looped back to its RX, and every byte makes the
+    trip out and back; with two ports, the second is whatever else is wired to the target's
+    USART (e.g. a second adapter), and each direction is timed on its own as well as both
+    at once; either way, the stream figures are one-way throughput, bytes delivered per second
+
+    with -s, no hardware is needed: each program given is a build of ptysim.c, which runs
+    the firmware's own main.c in real time behind a pair of pseudo-terminals, the adapter's
+    COM port and the far end of its USART; they are benchmarked in turn, as a pair of ports,
+    and compared at the end; the USB stack and the PIC's own execution time are not part of
+    it (see ptysim.c), so the figures show what main.c's buffering and coalescing of USART
+    data into IN packets cost at a given baud rate, not the whole adapter's performance
+
+    the latency test times lines of -l bytes, each ending in CDC_FLUSH_DELIMITER, so that
+    every coalescing policy usart.h offers has something to work with; to compare them,
+    build ptysim.c once per setting (usart.h takes them from the command line) and give
+    each build its own -s:
+    timeout    a partial packet goes once CDC_FLUSH_FRAMES have passed   -DCDC_NO_FLUSH_DELIMITER
+    delimiter  ... or as soon as a delimiter has been received           (as usart.h has it)
+    full       only full packets go, or partial ones after 255 frames    -DCDC_NO_FLUSH_DELIMITER -DCDC_FLUSH_FRAMES=255
+    ./cdcbench -s ./ptysim-timeout -s ./ptysim-delimiter -s ./ptysim-full
+
+    build (Linux): gcc -O2 -o cdcbench cdcbench.c -lpthread
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+/* see usart.h */
+#define FLUSH_DELIMITER	'\r'
+
+#define STREAM_CHUNK	4096
+#define READ_TIMEOUT_MS	2000
+#define LINE_MAX		256
+#define BUILDS_MAX		8
+
+struct result
+{
+	double p50, p99, rate;
+	unsigned long bytes, packets;
+};
+
+struct stream_job
+{
+	int fd;
+	unsigned long total;
+	unsigned long done;
+	double seconds;
+	int failed;
+};
+
+/* a running ptysim build; closing control (its stdin) ends it, and it reports on its stdout */
+struct simulation
+{
+	pid_t pid;
+	int control;
+	FILE *report;
+};
+
+static double now(void);
+static int open_port(const char *path, unsigned long baud);
+static int read_exact(int fd, unsigned char *buf, unsigned long len);
+static int compare_double(const void *a, const void *b);
+static void *writer_thread(void *arg);
+static void *reader_thread(void *arg);
+static int start_simulation(struct simulation *sim, const char *program, unsigned long baud, char **a_path, char **b_path);
+static unsigned long stop_simulation(struct simulation *sim);
+static double run_latency(const char *label, int out_fd, int in_fd, unsigned count, unsigned line, double *p99);
+static double run_stream(const char *label, int a_fd, int b_fd, unsigned long total, int both_ways);
+
+int main(int argc, char *argv[])
+{
+	unsigned long baud = 115200, total = 0;
+	unsigned count = 0, line = 16, builds = 0, build;
+	int opt, a_fd, b_fd;
+	char *a_path = NULL, *b_path = NULL;
+	const char *programs[BUILDS_MAX];
+	struct simulation sim;
+	struct result results[BUILDS_MAX];
+	double p99;
+
+	while ((opt = getopt(argc, argv, "b:n:t:l:s:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'b': baud = strtoul(optarg, NULL, 0); break;
+		case 'n': count = strtoul(optarg, NULL, 0); break;
+		case 't': total = strtoul(optarg, NULL, 0); break;
+		case 'l': line = strtoul(optarg, NULL, 0); break;
+		case 's':
+			if (BUILDS_MAX == builds)
+				goto usage;
+			programs[builds++] = optarg;
+			break;
+		default: goto usage;
+		}
+	}
+
+	if (optind < argc)
+		a_path = argv[optind];
+	if (optind + 1 < argc)
+		b_path = argv[optind + 1];
+
+	if ( (!builds == !a_path) || (line < 1) || (line > LINE_MAX) )
+	{
+usage:
+		fprintf(stderr, "%s [-b baud] [-n round_trips] [-l line_bytes] [-t stream_bytes] { -s <ptysim build> [-s ...] | <tty> [<tty2>] }\n", argv[0]);
+		fprintf(stderr, "  -s  benchmark main.c, built with ptysim.c, instead of real hardware\n");
+		return -1;
+	}
+
+	/* the simulation runs in real time, and a build that holds partial packets back can take 255 ms to deliver a line */
+	if (0 == count)
+		count = builds ? 100 : 1000;
+	if (0 == total)
+		total = builds ? 64 * 1024 : 256 * 1024;
+
+	if (!builds)
+	{
+		a_fd = open_port(a_path, baud);
+		if (a_fd < 0)
+			return -1;
+
+		b_fd = a_fd;
+		if (b_path)
+		{
+			b_fd = open_port(b_path, baud);
+			if (b_fd < 0)
+				return -1;
+		}
+
+		printf("%s at %lu bps%s\n", a_path, baud, (a_fd == b_fd) ? ", looped back" : "");
+
+		if (a_fd == b_fd)
+		{
+			/* looped back, every byte crosses the bus in both directions */
+			run_latency("round trip", a_fd, b_fd, count, line, &p99);
+			run_stream("one-way, looped back", a_fd, b_fd, total, 0);
+		}
+		else
+		{
+			run_latency("PC to target", a_fd, b_fd, count, line, &p99);
+			run_stream("one-way, PC to target", a_fd, b_fd, total, 0);
+			run_stream("bidirectional, total of both", a_fd, b_fd, total, 1);
+			run_latency("target to PC", b_fd, a_fd, count, line, &p99);
+			run_stream("one-way, target to PC", b_fd, a_fd, total, 0);
+		}
+
+		return 0;
+	}
+
+	for (build = 0; build < builds; build++)
+	{
+		if (start_simulation(&sim, programs[build], baud, &a_path, &b_path))
+			return -1;
+
+		a_fd = open_port(a_path, baud);
+		b_fd = open_port(b_path, baud);
+		if ( (a_fd < 0) || (b_fd < 0) )
+			return -1;
+
+		printf("%s at %lu bps, on %s and %s\n", programs[build], baud, a_path, b_path);
+
+		/* OUT packets are never held back, so the PC to target direction doesn't depend on usart.h */
+		results[build].bytes = count * line + total;
+		if (0 == build)
+		{
+			run_latency("PC to target", a_fd, b_fd, count, line, &p99);
+			run_stream("one-way, PC to target", a_fd, b_fd, total, 0);
+			run_stream("bidirectional, total of both", a_fd, b_fd, total, 1);
+			results[build].bytes += total;
+		}
+
+		results[build].p50 = run_latency("target to PC", b_fd, a_fd, count, line, &results[build].p99);
+		results[build].rate = run_stream("one-way, target to PC", b_fd, a_fd, total, 0);
+
+		close(a_fd);
+		close(b_fd);
+		free(a_path);
+		free(b_path);
+		results[build].packets = stop_simulation(&sim);
+	}
+
+	/* the trade-off: how soon a line reaches the PC, against how full the IN packets are */
+	printf("\ntarget to PC\nbuild                 %3u byte line p50/p99 (us)   stream (bytes/s)   bytes per IN packet\n", line);
+	for (build = 0; build < builds; build++)
+	{
+		printf("%-20s  %14.0f / %-9.0f   %16.0f   %19.1f\n", programs[build], results[build].p50, results[build].p99,
+			results[build].rate, results[build].packets ? (double)results[build].bytes / results[build].packets : 0.0);
+	}
+
+	return 0;
+}
+
+/* returns the median time for a line to arrive in us, and its 99th percentile in *p99 */
+static double run_latency(const char *label, int out_fd, int in_fd, unsigned count, unsigned line, double *p99)
+{
+	double *rtt, start, p50 = 0;
+	unsigned index, offset;
+	unsigned char tx[LINE_MAX], rx[LINE_MAX];
+
+	*p99 = 0;
+	if (0 == count)
+		return 0;
+
+	rtt = (double *)malloc(count * sizeof(double));
+	if (NULL == rtt)
+		return 0;
+
+	tcflush(in_fd, TCIFLUSH);
+
+	for (index = 0; index < count; index++)
+	{
+		/* a line of counting bytes, with the delimiter only at its end */
+		for (offset = 0; offset < line - 1; offset++)
+		{
+			tx[offset] = (unsigned char)(index + offset);
+			if (FLUSH_DELIMITER == tx[offset])
+				tx[offset]++;
+		}
+		tx[line - 1] = FLUSH_DELIMITER;
+
+		start = now();
+		if ( (write(out_fd, tx, line) != (ssize_t)line) || read_exact(in_fd, rx, line) )
+		{
+			fprintf(stderr, "ERROR: %s line %u timed out\n", label, index);
+			break;
+		}
+		rtt[index] = (now() - start) * 1e6;
+		if (memcmp(rx, tx, line))
+		{
+			fprintf(stderr, "ERROR: %s line %u arrived corrupted\n", label, index);
+			break;
+		}
+	}
+
+	if (index)
+	{
+		qsort(rtt, index, sizeof(double), compare_double);
+		printf("%s, %u byte line (us, %u lines): p50 %.0f  p90 %.0f  p99 %.0f  max %.0f\n", label, line, index,
+			rtt[index * 50 / 100], rtt[index * 90 / 100], rtt[index * 99 / 100], rtt[index - 1]);
+		p50 = rtt[index * 50 / 100];
+		*p99 = rtt[index * 99 / 100];
+	}
+
+	free(rtt);
+
+	return p50;
+}
+
+/* returns the throughput in bytes/s */
+static double run_stream(const char *label, int a_fd, int b_fd, unsigned long total, int both_ways)
+{
+	struct stream_job jobs[4];
+	pthread_t ids[4];
+	unsigned index, pairs = both_ways ? 2 : 1;
+	unsigned long received = 0;
+	double seconds = 0;
+
+	tcflush(a_fd, TCIOFLUSH);
+	tcflush(b_fd, TCIOFLUSH);
+
+	memset(jobs, 0, sizeof(jobs));
+	for (index = 0; index < pairs; index++)
+	{
+		/* writer on one end, reader on the other */
+		jobs[2 * index + 0].fd = index ? b_fd : a_fd;
+		jobs[2 * index + 1].fd = index ? a_fd : b_fd;
+		jobs[2 * index + 0].total = jobs[2 * index + 1].total = total;
+		pthread_create(&ids[2 * index + 1], NULL, reader_thread, &jobs[2 * index + 1]);
+		pthread_create(&ids[2 * index + 0], NULL, writer_thread, &jobs[2 * index + 0]);
+	}
+
+	for (index = 0; index < 2 * pairs; index++)
+		pthread_join(ids[index], NULL);
+
+	for (index = 0; index < pairs; index++)
+	{
+		received += jobs[2 * index + 1].done;
+		if (jobs[2 * index + 1].seconds > seconds)
+			seconds = jobs[2 * index + 1].seconds;
+		if (jobs[2 * index + 1].failed)
+			fprintf(stderr, "ERROR: %s stream stalled or corrupted after %lu bytes\n", label, jobs[2 * index + 1].done);
+	}
+
+	if (seconds <= 0)
+		return 0;
+
+	printf("%s: %lu bytes in %.3f s = %.0f bytes/s\n", label, received, seconds, received / seconds);
+
+	return received / seconds;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct stream_job *job = (struct stream_job *)arg;
+	unsigned char chunk[STREAM_CHUNK];
+	unsigned long length, index;
+	ssize_t written;
+
+	while (job->done < job->total)
+	{
+		length = job->total - job->done;
+		if (length > sizeof(chunk))
+			length = sizeof(chunk);
+		for (index = 0; index < length; index++)
+			chunk[index] = (unsigned char)(job->done + index);
+		written = write(job->fd, chunk, length);
+		if (written <= 0)
+		{
+			if ( (written < 0) && (EINTR == errno) )
+				continue;
+			job->failed = 1;
+			break;
+		}
+		job->done += written;
+	}
+
+	return NULL;
+}
+
+static void *reader_thread(void *arg)
+{
+	struct stream_job *job = (struct stream_job *)arg;
+	unsigned char chunk[STREAM_CHUNK];
+	struct pollfd pfd;
+	double start = 0;
+	ssize_t got, index;
+
+	pfd.fd = job->fd;
+	pfd.events = POLLIN;
+
+	while (job->done < job->total)
+	{
+		if (poll(&pfd, 1, READ_TIMEOUT_MS) <= 0)
+		{
+			job->failed = 1;
+			break;
+		}
+		got = read(job->fd, chunk, sizeof(chunk));
+		if (got <= 0)
+			continue;
+		/* time from the first byte received, so open/flush overhead isn't counted */
+		if (0 == job->done)
+			start = now();
+		for (index = 0; index < got; index++)
+		{
+			if (chunk[index] != (unsigned char)(job->done + index))
+				job->failed = 1;
+		}
+		job->done += got;
+		if (job->failed)
+			break;
+	}
+
+	job->seconds = now() - start;
+
+	return NULL;
+}
+
+/* run a ptysim build, and take the paths of its two pseudo-terminals from the first line it prints */
+static int start_simulation(struct simulation *sim, const char *program, unsigned long baud, char **a_path, char **b_path)
+{
+	int to_child[2], from_child[2];
+	char rate[16];
+
+	if (pipe(to_child) || pipe(from_child))
+		return -1;
+
+	sim->pid = fork();
+	if (sim->pid < 0)
+		return -1;
+
+	if (0 == sim->pid)
+	{
+		dup2(to_child[0], STDIN_FILENO);
+		dup2(from_child[1], STDOUT_FILENO);
+		close(to_child[0]); close(to_child[1]);
+		close(from_child[0]); close(from_child[1]);
+		snprintf(rate, sizeof(rate), "%lu", baud);
+		execl(program, program, rate, (char *)NULL);
+		_exit(127);
+	}
+
+	close(to_child[0]);
+	close(from_child[1]);
+	sim->control = to_child[1];
+	sim->report = fdopen(from_child[0], "r");
+
+	if ( (NULL == sim->report) || (2 != fscanf(sim->report, "%ms %ms", a_path, b_path)) )
+	{
+		fprintf(stderr, "ERROR: unable to start %s\n", program);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* returns the number of IN packets the simulation sent */
+static unsigned long stop_simulation(struct simulation *sim)
+{
+	unsigned long packets = 0, overruns = 0, lost = 0;
+
+	close(sim->control);
+	if ( (3 == fscanf(sim->report, " %lu IN packets, %lu USART overruns, %lu bytes lost on TX", &packets, &overruns, &lost)) &&
+		(overruns || lost) )
+	{
+		printf("simulated USART: %lu overruns, %lu bytes lost on TX\n", overruns, lost);
+	}
+	fclose(sim->report);
+	waitpid(sim->pid, NULL, 0);
+
+	return packets;
+}
+
+static int open_port(const char *path, unsigned long baud)
+{
+	static const struct { unsigned long rate; speed_t code; } speeds[] =
+	{
+		{ 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+		{ 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 }, { 500000, B500000 },
+		{ 921600, B921600 }, { 1000000, B1000000 }, { 1500000, B1500000 },
+		{ 2000000, B2000000 }, { 2500000, B2500000 }, { 3000000, B3000000 },
+	};
+	struct termios tio;
+	unsigned index;
+	int fd;
+
+	for (index = 0; index < sizeof(speeds) / sizeof(speeds[0]); index++)
+	{
+		if (speeds[index].rate == baud)
+			break;
+	}
+
+	if (index == sizeof(speeds) / sizeof(speeds[0]))
+	{
+		fprintf(stderr, "ERROR: unsupported baud rate %lu\n", baud);
+		return -1;
+	}
+
+	fd = open(path, O_RDWR | O_NOCTTY);
+
+	if ( (fd < 0) || tcgetattr(fd, &tio) )
+	{
+		fprintf(stderr, "ERROR: unable to open %s\n", path);
+		return -1;
+	}
+
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	cfsetspeed(&tio, speeds[index].code);
+
+	if (tcsetattr(fd, TCSANOW, &tio))
+	{
+		fprintf(stderr, "ERROR: unable to configure %s\n", path);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int read_exact(int fd, unsigned char *buf, unsigned long len)
+{
+	struct pollfd pfd;
+	ssize_t got;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while (len)
+	{
+		if (poll(&pfd, 1, READ_TIMEOUT_MS) <= 0)
+			return -1;
+		got = read(fd, buf, len);
+		if (got <= 0)
+			continue;
+		buf += got; len -= got;
+	}
+
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
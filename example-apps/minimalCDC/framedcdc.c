@@ -0,0 +1,74 @@
+/*
+    PC-side decoder for the packetized mode of the minimalCDC serial port adapter
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "framedcdc.h"
+
+void framed_decoder_init(struct framed_decoder *decoder)
+{
+	memset(decoder, 0, sizeof(*decoder));
+}
+
+unsigned framed_decode(struct framed_decoder *decoder, const unsigned char *data, unsigned long len, framed_callback on_frame, void *context)
+{
+	unsigned frames = 0, chunk;
+
+	while (len)
+	{
+		if (!decoder->have_length)
+		{
+			decoder->length = *data++; len--;
+			decoder->filled = 0;
+			decoder->have_length = 1;
+		}
+
+		/* a frame lying wholly within the data is passed on in place, without copying */
+		if ( (0 == decoder->filled) && (len >= decoder->length) )
+		{
+			if (on_frame)
+				on_frame(context, data, decoder->length);
+			data += decoder->length; len -= decoder->length;
+			decoder->have_length = 0;
+			frames++;
+			continue;
+		}
+
+		chunk = decoder->length - decoder->filled;
+		if (chunk > len)
+			chunk = len;
+		memcpy(decoder->frame + decoder->filled, data, chunk);
+		decoder->filled += chunk;
+		data += chunk; len -= chunk;
+
+		if (decoder->filled == decoder->length)
+		{
+			if (on_frame)
+				on_frame(context, decoder->frame, decoder->length);
+			decoder->have_length = 0;
+			frames++;
+		}
+	}
+
+	return frames;
+}
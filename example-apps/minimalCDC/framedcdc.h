@@ -0,0 +1,55 @@
+/*
+    PC-side decoder for the packetized mode of the minimalCDC serial port adapter (see CDC_FRAMED_MODE in usart.h)
+
+    the adapter sends a stream of frames, each a length byte followed by that many payload bytes;
+    frames are packed back to back and may straddle USB packets (and so reads from the port),
+    so the decoder keeps the partial frame between calls
+
+    usage:
+        struct framed_decoder decoder;
+        framed_decoder_init(&decoder);
+        while ((len = read(fd, buf, sizeof(buf))) > 0)
+            framed_decode(&decoder, buf, len, on_frame, context);
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef FRAMEDCDC_H__
+#define FRAMEDCDC_H__
+
+#define FRAMED_MAX_PAYLOAD 255
+
+struct framed_decoder
+{
+	unsigned char frame[FRAMED_MAX_PAYLOAD];
+	unsigned length;  /* payload length of the frame being assembled */
+	unsigned filled;  /* payload bytes of it received so far */
+	int have_length;  /* the length byte of the frame being assembled has been received */
+};
+
+typedef void (*framed_callback)(void *context, const unsigned char *payload, unsigned length);
+
+void framed_decoder_init(struct framed_decoder *decoder);
+
+/* feed bytes read from the port; on_frame is called for every frame completed by them, and the number of such frames is returned */
+unsigned framed_decode(struct framed_decoder *decoder, const unsigned char *data, unsigned long len, framed_callback on_frame, void *context);
+
+#endif /* FRAMEDCDC_H__ */
@@ -0,0 +1,276 @@
+/*
+    host-side test of framedcdc.c, the PC-side decoder for CDC_FRAMED_MODE
+
+    a stream of frames, each a length byte followed by that much payload, is built as
+    main.c would send it and fed to framed_decode() in pieces, as reads from the port
+    would return it; every payload that comes out is checked against the one that went in:
+    - split: the stream is cut into reads of every size from 1 to 2 * EP_2_IN_LEN bytes,
+      and of pseudo-random sizes, so that both length bytes and payloads straddle reads
+    - delimiter: frames whose length byte, or whose payload bytes, have the value of
+      CDC_FLUSH_DELIMITER (a 13 byte frame; payloads as sent with the delimiter disabled)
+      must come out as any other, since the framing has no escapes and relies on lengths
+    - truncated: the stream is cut at every offset; only the frames that end before the cut
+      may come out, the partial one must be kept, and the rest of the stream must then
+      complete it; a decoder that is reinitialized at the cut (the port reopened) must
+      lose the partial frame and decode a fresh stream from its start
+    - a zero length frame, which main.c never sends, comes out empty and doesn't
+      disturb the frames after it
+
+    gcc -O2 -Wall -o framedsim framedsim.c framedcdc.c
+    ./framedsim
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "framedcdc.h"
+
+/* see usart.h and usb_config.h */
+#define DELIMITER		'\r'
+#define FRAME_MAX		120
+#define EP_2_IN_LEN		64
+
+#define FRAMES_MAX		64
+#define STREAM_MAX		(FRAMES_MAX * (1 + FRAMED_MAX_PAYLOAD))
+
+struct stream
+{
+	unsigned char bytes[STREAM_MAX];
+	unsigned long len;
+	unsigned frames;
+	unsigned long offset[FRAMES_MAX];	/* of each frame's length byte */
+};
+
+/* what has come out of the decoder, checked against the stream as it arrives */
+struct check
+{
+	const struct stream *stream;
+	unsigned next;
+	unsigned errors;
+};
+
+static unsigned long seed = 1;
+
+static unsigned next_random(void)
+{
+	seed = seed * 1103515245UL + 12345UL;
+	return (unsigned)(seed >> 16) & 0x7FFF;
+}
+
+static void add_frame(struct stream *stream, const unsigned char *payload, unsigned length)
+{
+	stream->offset[stream->frames++] = stream->len;
+	stream->bytes[stream->len++] = (unsigned char)length;
+	memcpy(stream->bytes + stream->len, payload, length);
+	stream->len += length;
+}
+
+/* frames of the lengths main.c sends, 1 to CDC_FRAME_MAX, and the longest the decoder takes */
+static void make_stream(struct stream *stream, unsigned frames)
+{
+	unsigned char payload[FRAMED_MAX_PAYLOAD];
+	unsigned i, length;
+
+	memset(stream, 0, sizeof(*stream));
+	while (stream->frames < frames)
+	{
+		length = (stream->frames == frames - 1) ? FRAMED_MAX_PAYLOAD : 1 + next_random() % FRAME_MAX;
+		for (i = 0; i < length; i++)
+			payload[i] = (unsigned char)next_random();
+		add_frame(stream, payload, length);
+	}
+}
+
+static void on_frame(void *context, const unsigned char *payload, unsigned length)
+{
+	struct check *check = (struct check *)context;
+	const struct stream *stream = check->stream;
+	unsigned long offset;
+
+	if (check->next >= stream->frames)
+	{
+		check->errors++;
+		return;
+	}
+
+	offset = stream->offset[check->next++];
+	if ( (length != stream->bytes[offset]) || memcmp(payload, stream->bytes + offset + 1, length) )
+		check->errors++;
+}
+
+/* the frames of stream that end at or before offset */
+static unsigned frames_before(const struct stream *stream, unsigned long offset)
+{
+	unsigned frames = 0;
+
+	while ( (frames < stream->frames) && (stream->offset[frames] + 1 + stream->bytes[stream->offset[frames]] <= offset) )
+		frames++;
+
+	return frames;
+}
+
+/* feed the whole stream in reads of size (or of pseudo-random sizes up to 2 * EP_2_IN_LEN, if size is zero) */
+static int feed(const struct stream *stream, unsigned long size)
+{
+	struct framed_decoder decoder;
+	struct check check = { stream, 0, 0 };
+	unsigned long done = 0, len;
+	unsigned frames = 0;
+
+	framed_decoder_init(&decoder);
+	while (done < stream->len)
+	{
+		len = size ? size : 1 + next_random() % (2 * EP_2_IN_LEN);
+		if (len > stream->len - done)
+			len = stream->len - done;
+		frames += framed_decode(&decoder, stream->bytes + done, len, on_frame, &check);
+		done += len;
+	}
+
+	return check.errors || (check.next != stream->frames) || (frames != stream->frames);
+}
+
+static int test_split(void)
+{
+	struct stream stream;
+	unsigned long size, failures = 0;
+	unsigned run;
+
+	make_stream(&stream, FRAMES_MAX);
+
+	for (size = 1; size <= 2 * EP_2_IN_LEN; size++)
+		failures += feed(&stream, size);
+	failures += feed(&stream, stream.len);
+	for (run = 0; run < 1000; run++)
+		failures += feed(&stream, 0);
+
+	printf("%s split: %u frames, %lu bytes, in reads of 1 to %u bytes, all at once, and 1000 random ways; %lu failed\n",
+		failures ? "FAIL" : "ok  ", stream.frames, stream.len, 2 * EP_2_IN_LEN, failures);
+
+	return failures ? 1 : 0;
+}
+
+static int test_delimiter(void)
+{
+	struct stream stream;
+	unsigned char payload[FRAMED_MAX_PAYLOAD];
+	unsigned long size, failures = 0;
+	unsigned i;
+
+	memset(&stream, 0, sizeof(stream));
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = (unsigned char)(i * 7);
+	/* a length byte that is the delimiter, around a payload that holds it */
+	add_frame(&stream, payload, DELIMITER);
+	memset(payload, DELIMITER, sizeof(payload));
+	add_frame(&stream, payload, DELIMITER);
+	add_frame(&stream, payload, 1);
+	add_frame(&stream, payload, FRAME_MAX);
+	payload[0] = 'A';
+	add_frame(&stream, payload, DELIMITER + 1);
+	add_frame(&stream, payload, 2);
+
+	for (size = 1; size <= stream.len; size++)
+		failures += feed(&stream, size);
+
+	printf("%s delimiter: %u frames of delimiter-valued lengths and payloads, in reads of every size; %lu failed\n",
+		failures ? "FAIL" : "ok  ", stream.frames, failures);
+
+	return failures ? 1 : 0;
+}
+
+static int test_truncated(void)
+{
+	struct stream stream, fresh;
+	struct framed_decoder decoder;
+	struct check check, check_fresh;
+	unsigned long cut, failures = 0;
+	unsigned frames;
+
+	make_stream(&stream, 8);
+	make_stream(&fresh, 4);
+
+	for (cut = 0; cut <= stream.len; cut++)
+	{
+		/* the stream stops at cut, and then carries on */
+		check.stream = &stream; check.next = 0; check.errors = 0;
+		framed_decoder_init(&decoder);
+		frames = framed_decode(&decoder, stream.bytes, cut, on_frame, &check);
+		if ( check.errors || (frames != frames_before(&stream, cut)) || (check.next != frames) )
+		{
+			failures++;
+			continue;
+		}
+		frames += framed_decode(&decoder, stream.bytes + cut, stream.len - cut, on_frame, &check);
+		if ( check.errors || (frames != stream.frames) || (check.next != stream.frames) )
+			failures++;
+
+		/* the port is reopened at cut, and a new stream starts */
+		check.stream = &stream; check.next = 0; check.errors = 0;
+		framed_decoder_init(&decoder);
+		framed_decode(&decoder, stream.bytes, cut, on_frame, &check);
+		check_fresh.stream = &fresh; check_fresh.next = 0; check_fresh.errors = 0;
+		framed_decoder_init(&decoder);
+		frames = framed_decode(&decoder, fresh.bytes, fresh.len, on_frame, &check_fresh);
+		if ( check_fresh.errors || (frames != fresh.frames) || (check_fresh.next != fresh.frames) )
+			failures++;
+	}
+
+	printf("%s truncated: %u frames, %lu bytes, cut at every offset, then resumed or restarted; %lu failed\n",
+		failures ? "FAIL" : "ok  ", stream.frames, stream.len, failures);
+
+	return failures ? 1 : 0;
+}
+
+static int test_empty(void)
+{
+	struct stream stream;
+	unsigned char payload[4] = { 1, 2, 3, 4 };
+	unsigned long size, failures = 0;
+
+	memset(&stream, 0, sizeof(stream));
+	add_frame(&stream, payload, 4);
+	add_frame(&stream, payload, 0);
+	add_frame(&stream, payload, 0);
+	add_frame(&stream, payload, 3);
+
+	for (size = 1; size <= stream.len; size++)
+		failures += feed(&stream, size);
+
+	printf("%s empty: zero length frames between others, in reads of every size; %lu failed\n",
+		failures ? "FAIL" : "ok  ", failures);
+
+	return failures ? 1 : 0;
+}
+
+int main(void)
+{
+	int failures = 0;
+
+	failures += test_split();
+	failures += test_delimiter();
+	failures += test_truncated();
+	failures += test_empty();
+
+	return failures ? 1 : 0;
+}
@@ -273,6 +273,24 @@ struct cdc_line_coding {
  */
 uint8_t process_cdc_setup_request(const struct setup_packet *setup);
 
+#ifdef MULTI_CLASS_DEVICE
+/** Set the list of CDC interfaces on this device
+ *
+ * Provide a list to the CDC class implementation of the interfaces on this
+ * device which should be treated as CDC devices.  This is only necessary
+ * for multi-class composite devices to make sure that requests are not
+ * confused between interfaces.  It should be called before usb_init().
+ *
+ * The list is converted into a bitmap when this function is called, so
+ * it need not remain valid afterward.  Interface numbers must be less
+ * than CDC_MAX_INTERFACES (default 16, may be set in usb_config.h).
+ *
+ * @param interfaces      An array of interfaces which are CDC class.
+ * @param num_interfaces  The size of the @p interfaces array.
+ */
+void cdc_set_interface_list(uint8_t *interfaces, uint8_t num_interfaces);
+#endif
+
 /** CDC SEND_ENCAPSULATED_COMMAND callback
  *
  * The USB Stack will call this function when a GET_ENCAPSULATED_COMMAND
@@ -30,42 +30,112 @@
 */
 
 #include "usb.h"
+#ifdef RINGSIM
+#include "ringsim.h"
+#else
 #include <xc.h>
+#endif
 #include <string.h>
 #include "usb_config.h"
 #include "usb_ch9.h"
 #include "usb_cdc.h"
+#include "usart.h"
 
-/* local data buffers for CDC functionality */
-static uint8_t PC2PIC_Buffer[EP_2_LEN];
-static uint8_t PIC2PC_Buffer[EP_2_LEN];
+/*
+    USART ring buffers; the lengths must be powers of two no larger than 128,
+    so that the free-running uint8_t head/tail indices wrap cleanly
+*/
+#define PIC2PC_RING_LEN 128
+#define PC2PIC_RING_LEN 128
 
-/* variables to track positions and occupancy in local CDC buffers */
-uint8_t PIC2PC_pending_count;
-size_t  PC2PIC_buffer_occupancy;
-uint8_t PC2PIC_read_index;
+#if (PIC2PC_RING_LEN & (PIC2PC_RING_LEN - 1)) || (PIC2PC_RING_LEN > 128)
+#error "PIC2PC_RING_LEN must be a power of two no larger than 128"
+#endif
+#if (PC2PIC_RING_LEN & (PC2PIC_RING_LEN - 1)) || (PC2PIC_RING_LEN > 128)
+#error "PC2PIC_RING_LEN must be a power of two no larger than 128"
+#endif
+
+/* USART RX -> USB IN; head is advanced only by isr(), tail only by main() */
+static uint8_t PIC2PC_Ring[PIC2PC_RING_LEN];
+static volatile uint8_t PIC2PC_head;
+static volatile uint8_t PIC2PC_tail;
+
+/* USB OUT -> USART TX; head is advanced only by main(), tail only by isr() */
+static uint8_t PC2PIC_Ring[PC2PIC_RING_LEN];
+static volatile uint8_t PC2PIC_head;
+static volatile uint8_t PC2PIC_tail;
+
+#if defined(USART_RTS_CTS) || defined(USART_DTR_RTS)
+#define RTS_LAT LATCbits.LATC3
+#endif
+#ifdef USART_DTR_RTS
+#define DTR_LAT LATCbits.LATC1
+#endif
+
+#ifdef USART_RTS_CTS
+#define CTS_PORT PORTCbits.RC2
+
+/* RTS is dropped once the USART->USB ring is this full, leaving room for what the target sends before it reacts */
+#define RTS_OFF_LEVEL (PIC2PC_RING_LEN - 16)
+/* ... and raised again once it has drained to here */
+#define RTS_ON_LEVEL (PIC2PC_RING_LEN / 2)
+
+static volatile bool host_rts;
+#endif
+
+/* coalescing state; see CDC_FLUSH_FRAMES and CDC_FLUSH_DELIMITER in usart.h */
+static volatile uint8_t pic2pc_frames; /* frames started with data pending */
+#ifdef CDC_FLUSH_DELIMITER
+static volatile bool pic2pc_delimiter; /* a delimiter has been received since the last flush */
+#endif
+
+#ifdef CDC_FRAMED_MODE
+#if (CDC_FRAME_MAX + 1) > PIC2PC_RING_LEN
+#error "CDC_FRAME_MAX plus its length byte must fit in PIC2PC_RING_LEN"
+#endif
+/* bytes before PIC2PC_committed form whole frames; the open frame's length byte is at frame_start */
+static volatile uint8_t PIC2PC_committed;
+static volatile uint8_t frame_start;
+static volatile bool frame_open;
+
+static void StoreFramedByte(uint8_t rx);
+static void CloseFrame(void);
+#endif
+
+/*
+    break state; see SendUSARTBreak() in usart.h
+    break_frames and break_active are only touched from usb_service(), by the SEND_BREAK and SOF callbacks
+*/
+#define BREAK_UNTIL_CLEARED 0xFFFF
+static uint16_t break_frames; /* frames left to hold TX low */
+static bool break_active; /* the transmitter is disabled and TX is driven low from LATC4 */
+static volatile bool break_requested; /* isr() stops feeding TXREG while this is set */
+
+static void EndBreak(void);
+
+/* line errors since the last SERIAL_STATE notification; set by isr(), cleared by main() */
+#define SERIAL_STATE_OVERRUN 0x01
+#define SERIAL_STATE_FRAMING 0x02
+static volatile uint8_t serial_state_events;
 
 static void InitializeUSART(void);
+static void SendSerialState(void);
 
 int main(void)
 {
-	uint8_t pc2pic_data_ready;
 	uint8_t *in_buf;
 	const uint8_t *out_buf;
-	int i;
+	uint8_t count, i;
+	bool flush;
 
-	pc2pic_data_ready = 0;
+	PIC2PC_head = PIC2PC_tail = 0;
+	PC2PIC_head = PC2PIC_tail = 0;
 
 	InitializeUSART();
 
-	PIC2PC_pending_count = 0;
-	PC2PIC_buffer_occupancy = 0;
-
-/* Configure interrupts, per architecture */
-#ifdef USB_USE_INTERRUPTS
+	/* the USART is interrupt-driven regardless of USB_USE_INTERRUPTS */
 	INTCONbits.PEIE = 1;
 	INTCONbits.GIE = 1;
-#endif
 
 	usb_init();
 
@@ -79,70 +149,215 @@ int main(void)
 		if (!usb_is_configured())
 			continue;
 
-		/* if the USART has received another byte, add it to the queue if there is room */
-		if (PIR1bits.RCIF && (PIC2PC_pending_count < (EP_2_LEN - 1)))
+#ifdef USART_RTS_CTS
+		/* isr() stops the transmitter while CTS is deasserted; restart it once the target is ready again */
+		if (!CTS_PORT && (PC2PIC_head != PC2PIC_tail))
+			PIE1bits.TXIE = 1;
+#endif
+
+		/* report line errors on the notification endpoint */
+		if (serial_state_events && !usb_in_endpoint_busy(1))
+			SendSerialState();
+
+		/* if the PC can accept more data and the USART has received some, hand it over */
+		if (!usb_in_endpoint_halted(2) && !usb_in_endpoint_busy(2))
 		{
-			if (RCSTAbits.OERR)
-				RCSTAbits.CREN = 0;  /* in case of overrun error, reset the port */
-			PIC2PC_Buffer[PIC2PC_pending_count] = RCREG;
-			RCSTAbits.CREN = 1;  /* and then (re-)enable receive */
-			++PIC2PC_pending_count;
+			/* consume the flush triggers before sampling the ring, so none raised meanwhile get lost */
+			flush = (pic2pc_frames >= CDC_FLUSH_FRAMES);
+#ifdef CDC_FLUSH_DELIMITER
+			if (pic2pc_delimiter)
+				flush = true;
+#endif
+			if (flush)
+			{
+				pic2pc_frames = 0;
+#ifdef CDC_FLUSH_DELIMITER
+				pic2pc_delimiter = false;
+#endif
+			}
+
+#ifdef CDC_FRAMED_MODE
+			/* only whole frames are handed over, so the PC never waits on a length byte */
+			count = PIC2PC_committed - PIC2PC_tail;
+#else
+			count = PIC2PC_head - PIC2PC_tail;
+#endif
+
+			/*
+			stay one byte short of a full packet; a full packet would
+			otherwise have to be followed by a ZLP to end the host's read
+			*/
+			if (count >= (EP_2_IN_LEN - 1))
+			{
+				count = EP_2_IN_LEN - 1;
+				flush = true;
+			}
+
+			if (flush && (count > 0))
+			{
+				in_buf = usb_get_in_buffer(2);
+				for (i = 0; i < count; i++)
+					in_buf[i] = PIC2PC_Ring[(uint8_t)(PIC2PC_tail + i) & (PIC2PC_RING_LEN - 1)];
+				usb_send_in_buffer(2, count);
+				/* only now release the space back to isr() */
+				PIC2PC_tail += count;
+			}
+
+#ifdef USART_RTS_CTS
+			/* isr() drops RTS when the ring fills; raise it again once there's room */
+			if (host_rts && ((uint8_t)(PIC2PC_head - PIC2PC_tail) <= RTS_ON_LEVEL))
+				RTS_LAT = 0;
+#endif
 		}
 
-		/* if our PC2PIC buffer is not empty *AND* the USART can accept another byte, transmit another byte */
-		if (pc2pic_data_ready && TXSTAbits.TRMT)
+		/*
+		EP2 OUT is ping-ponged, so the SIE keeps receiving into one buffer while the other is
+		being emptied here; drain every buffer holding data, as long as a whole packet is guaranteed
+		to fit in the ring
+		*/
+		while ((uint8_t)(PC2PIC_head - PC2PIC_tail) <= (PC2PIC_RING_LEN - EP_2_OUT_LEN))
 		{
-			/* transmit another byte from buffer */
-			TXREG = PC2PIC_Buffer[PC2PIC_read_index];
-			/* update the read index */
-	    		++PC2PIC_read_index;
-			/* if the read_index has reached the occupancy value, signal that the buffer is empty again */
-	    		if (PC2PIC_read_index == PC2PIC_buffer_occupancy)
-	    			pc2pic_data_ready = 0;
+			/* if we pass this test, we are committed to make the usb_arm_out_endpoint() call */
+			if (!usb_out_endpoint_has_data(2))
+				break;
+
+			/* ask USB stack for more PC2PIC data */
+			count = usb_get_out_buffer(2, &out_buf);
+
+			/* if there was any, put it in the ring and (re-)start the transmitter */
+			if (count > 0)
+			{
+				for (i = 0; i < count; i++)
+					PC2PIC_Ring[(uint8_t)(PC2PIC_head + i) & (PC2PIC_RING_LEN - 1)] = out_buf[i];
+				PC2PIC_head += count;
+				PIE1bits.TXIE = 1;
+			}
+
+			/* hand the buffer straight back to the SIE */
+			usb_arm_out_endpoint(2);
 		}
+	}
+}
 
-		/* proceed further only if the PC can accept more data */
-		if (usb_in_endpoint_halted(2) || usb_in_endpoint_busy(2))
-			continue;
+#ifdef CDC_FRAMED_MODE
+/* called from isr() for every byte received */
+static void StoreFramedByte(uint8_t rx)
+{
+	uint8_t space;
 
-		/* if we've reached here, the USB stack can accept more; if we have PIC2PC data to send, we hand it over */
-		if (PIC2PC_pending_count > 0)
+#ifdef CDC_FLUSH_DELIMITER
+	if (CDC_FLUSH_DELIMITER == rx)
+	{
+		/* a delimiter with no payload before it doesn't make an (empty) frame */
+		if (frame_open)
 		{
-			in_buf = usb_get_in_buffer(2);
-			memcpy(in_buf, PIC2PC_Buffer, PIC2PC_pending_count);
-			usb_send_in_buffer(2, PIC2PC_pending_count);
-			PIC2PC_pending_count = 0;
+			CloseFrame();
+			pic2pc_delimiter = true;
 		}
+		return;
+	}
+#endif
 
-		/* if our PC2PIC buffer is NOT empty, we won't go further (where we would try to accept more from the PC) */
-		if (pc2pic_data_ready)
-			continue;
+	/* the first byte of a frame also needs room for the length byte in front of it */
+	space = PIC2PC_RING_LEN - (uint8_t)(PIC2PC_head - PIC2PC_tail);
+	if (space < (frame_open ? 1 : 2))
+	{
+		/* the byte is discarded, but the frame stays consistent as its length is what was stored */
+		serial_state_events |= SERIAL_STATE_OVERRUN;
+		return;
+	}
 
-		/* if we pass this test, we are committed to make the usb_arm_out_endpoint() call */
-		if (!usb_out_endpoint_has_data(2))
-			continue;
+	if (!frame_open)
+	{
+		frame_start = PIC2PC_head;
+		++PIC2PC_head;
+		frame_open = true;
+	}
 
-		/* ask USB stack for more PC2PIC data */
-		PC2PIC_buffer_occupancy = usb_get_out_buffer(2, &out_buf);
+	PIC2PC_Ring[PIC2PC_head & (PIC2PC_RING_LEN - 1)] = rx;
+	++PIC2PC_head;
 
-		/* if there was any, put it in the buffer and update the state variables */
-		if(PC2PIC_buffer_occupancy > 0)
-		{
-			memcpy(PC2PIC_Buffer, out_buf, PC2PIC_buffer_occupancy);
-			/* signal that the buffer is not empty */
-			pc2pic_data_ready = 1;
-			/* rewind read index to the beginning of the buffer */
-			PC2PIC_read_index = 0;
-		}
+	if ((uint8_t)(PIC2PC_head - frame_start - 1) >= CDC_FRAME_MAX)
+		CloseFrame();
+}
 
-		usb_arm_out_endpoint(2);
-	}
+/* fill in the open frame's length byte and release it to main(); interrupts must be off */
+static void CloseFrame(void)
+{
+	PIC2PC_Ring[frame_start & (PIC2PC_RING_LEN - 1)] = (uint8_t)(PIC2PC_head - frame_start - 1);
+	PIC2PC_committed = PIC2PC_head;
+	frame_open = false;
 }
+#endif
 
 void interrupt isr()
 {
+	uint8_t rx;
+
+	/* move every received byte into the ring as it arrives, so usb_service() latency can't overrun the USART */
+	if (PIR1bits.RCIF)
+	{
+		if (RCSTAbits.OERR)
+		{
+			/* in case of overrun error, reset the port */
+			RCSTAbits.CREN = 0;
+			RCSTAbits.CREN = 1;
+			serial_state_events |= SERIAL_STATE_OVERRUN;
+		}
+		/* FERR applies to the byte about to be read */
+		if (RCSTAbits.FERR)
+			serial_state_events |= SERIAL_STATE_FRAMING;
+		rx = RCREG;
+#ifdef CDC_FRAMED_MODE
+		StoreFramedByte(rx);
+#else
+		/* if the ring is full (e.g. USB isn't configured), the byte is discarded */
+		if ((uint8_t)(PIC2PC_head - PIC2PC_tail) < PIC2PC_RING_LEN)
+		{
+			PIC2PC_Ring[PIC2PC_head & (PIC2PC_RING_LEN - 1)] = rx;
+			++PIC2PC_head;
+#ifdef CDC_FLUSH_DELIMITER
+			if (CDC_FLUSH_DELIMITER == rx)
+				pic2pc_delimiter = true;
+#endif
+		}
+		else
+		{
+			serial_state_events |= SERIAL_STATE_OVERRUN;
+		}
+#endif
+#ifdef USART_RTS_CTS
+		if ((uint8_t)(PIC2PC_head - PIC2PC_tail) >= RTS_OFF_LEVEL)
+			RTS_LAT = 1;
+#endif
+	}
+
+	/* feed TXREG whenever it is empty; the interrupt is disabled once the ring runs dry */
+	if (PIE1bits.TXIE && PIR1bits.TXIF)
+	{
+		/* nothing is sent during a break; EndBreak() restarts the transmitter */
+		if (break_requested)
+			PIE1bits.TXIE = 0;
+		else
+#ifdef USART_RTS_CTS
+		/* the target isn't ready; main() re-enables the interrupt when CTS returns */
+		if (CTS_PORT)
+			PIE1bits.TXIE = 0;
+		else
+#endif
+		if (PC2PIC_head != PC2PIC_tail)
+		{
+			TXREG = PC2PIC_Ring[PC2PIC_tail & (PC2PIC_RING_LEN - 1)];
+			++PC2PIC_tail;
+		}
+		else
+		{
+			PIE1bits.TXIE = 0;
+		}
+	}
+
 #ifdef USB_USE_INTERRUPTS
-    usb_service();
+	usb_service();
 #endif
 }
 
@@ -151,18 +366,187 @@ static void InitializeUSART(void)
 	/* RX on RC5 is an input */
         TRISCbits.TRISC5=1;
 
-	/* TX on RC4 is an output */
+	/* TX on RC4 is an output; its latch is left low, for the transmitter to fall back on during a break */
+	LATCbits.LATC4 = 0;
         TRISCbits.TRISC4=0;
 
+#ifdef USART_RTS_CTS
+	/* CTS on RC2 is a digital input */
+	ANSELCbits.ANSC2 = 0;
+	TRISCbits.TRISC2 = 1;
+
+	/* RTS on RC3 is an output, deasserted until the host raises it */
+	ANSELCbits.ANSC3 = 0;
+	RTS_LAT = 1;
+	TRISCbits.TRISC3 = 0;
+	host_rts = false;
+#elif defined(USART_DTR_RTS)
+	/* RTS on RC3 is an output, deasserted until the host raises it */
+	ANSELCbits.ANSC3 = 0;
+	RTS_LAT = 1;
+	TRISCbits.TRISC3 = 0;
+#endif
+
+#ifdef USART_DTR_RTS
+	/* DTR on RC1 is an output, deasserted until the host raises it */
+	ANSELCbits.ANSC1 = 0;
+	DTR_LAT = 1;
+	TRISCbits.TRISC1 = 0;
+#endif
+
 	TXSTA = 0x24;
 	RCSTA = 0x90;
 
-	/* 115200 bps */
-	SPBRG  = 103;
-	SPBRGH = 0;
-
+	/* BRG16 */
 	BAUDCON = 0x08;
 
+	SetUSARTBaudRate(USART_DEFAULT_BPS);
+
 	/* clear any data in receive buffer */
 	(volatile void)RCREG;
+
+	/* receive is interrupt-driven; transmit interrupts are enabled on demand by main() */
+	PIE1bits.TXIE = 0;
+	PIE1bits.RCIE = 1;
+}
+
+/* the USART is clocked from the 48 MHz system clock */
+#define USART_FOSC 48000000UL
+
+uint32_t SetUSARTBaudRate(uint32_t bps)
+{
+	uint32_t divisor;
+	uint8_t prescale;
+
+	/* with BRGH set, the rate is Fosc / (4 * (SPBRG + 1)): 12 Mbps down to 183 bps */
+	prescale = 4;
+	if (bps > (USART_FOSC / 4))
+		return 0;
+	if (bps < (USART_FOSC / 4 / 65536UL))
+	{
+		/* with BRGH clear, the rate is Fosc / (16 * (SPBRG + 1)), reaching down to 46 bps */
+		prescale = 16;
+		if (bps < (USART_FOSC / 16 / 65536UL))
+			return 0;
+	}
+
+	/* round to the nearest divisor */
+	divisor = (USART_FOSC / prescale + bps / 2) / bps;
+	if (divisor > 65536UL)
+		divisor = 65536UL;
+
+	TXSTAbits.BRGH = (4 == prescale);
+	SPBRGH = (uint8_t)((divisor - 1) >> 8);
+	SPBRG  = (uint8_t)(divisor - 1);
+
+	return USART_FOSC / prescale / divisor;
+}
+
+void USARTStartOfFrame(void)
+{
+#ifdef CDC_FRAMED_MODE
+	bool gie;
+
+#endif
+	/* a break is timed in whole frames from the one in which it starts */
+	if (break_requested)
+	{
+		if (!break_active)
+		{
+			/* let the byte in flight finish rather than cut it short */
+			if (TXSTAbits.TRMT)
+			{
+				TXSTAbits.TXEN = 0;
+				break_active = true;
+			}
+		}
+		else if ((BREAK_UNTIL_CLEARED != break_frames) && (0 == --break_frames))
+		{
+			EndBreak();
+		}
+	}
+
+	/* the timeout only runs while there is something waiting to be sent */
+	if ((PIC2PC_head != PIC2PC_tail) && (pic2pc_frames < 0xFF))
+		++pic2pc_frames;
+
+#ifdef CDC_FRAMED_MODE
+	/* a frame left open for the whole timeout is closed as it stands */
+	if (pic2pc_frames >= CDC_FLUSH_FRAMES)
+	{
+		/* this may already be running inside isr() when USB_USE_INTERRUPTS is defined */
+		gie = INTCONbits.GIE;
+		INTCONbits.GIE = 0;
+		if (frame_open)
+			CloseFrame();
+		INTCONbits.GIE = gie;
+	}
+#endif
+}
+
+void SetUSARTControlLines(bool dtr, bool rts)
+{
+#ifdef USART_DTR_RTS
+	DTR_LAT = !dtr;
+#endif
+#ifdef USART_RTS_CTS
+	host_rts = rts;
+	if (!rts)
+		RTS_LAT = 1;
+	else if ((uint8_t)(PIC2PC_head - PIC2PC_tail) <= RTS_ON_LEVEL)
+		RTS_LAT = 0;
+#elif defined(USART_DTR_RTS)
+	RTS_LAT = !rts;
+#endif
+}
+
+void SendUSARTBreak(uint16_t duration)
+{
+	if (0 == duration)
+	{
+		EndBreak();
+		return;
+	}
+
+	/* a new request restarts the timing of one already in progress */
+	break_frames = duration;
+	break_requested = true;
+	PIE1bits.TXIE = 0;
+}
+
+static void EndBreak(void)
+{
+	if (break_active)
+		TXSTAbits.TXEN = 1;
+	break_active = false;
+	break_frames = 0;
+	break_requested = false;
+
+	/* pick up whatever the host queued meanwhile */
+	if (PC2PIC_head != PC2PIC_tail)
+		PIE1bits.TXIE = 1;
+}
+
+static void SendSerialState(void)
+{
+	struct cdc_serial_state_notification *notification;
+	uint8_t events;
+
+	/* claim the pending events without losing any that isr() raises meanwhile */
+	INTCONbits.GIE = 0;
+	events = serial_state_events;
+	serial_state_events = 0;
+	INTCONbits.GIE = 1;
+
+	notification = (struct cdc_serial_state_notification *)usb_get_in_buffer(1);
+	notification->header.REQUEST.bmRequestType = 0xa1;
+	notification->header.bNotification = CDC_SERIAL_STATE;
+	notification->header.wValue = 0;
+	notification->header.wIndex = 0; /* the CDC class interface */
+	notification->header.wLength = sizeof(notification->data);
+	/* overrun and framing are irregular signals; the host treats them as one-shot events */
+	notification->data.serial_state = 0;
+	notification->data.bits.bOverrun = (events & SERIAL_STATE_OVERRUN) ? 1 : 0;
+	notification->data.bits.bFraming = (events & SERIAL_STATE_FRAMING) ? 1 : 0;
+	usb_send_in_buffer(1, sizeof(*notification));
 }
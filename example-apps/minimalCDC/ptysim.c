@@ -0,0 +1,440 @@
+/*
+    minimalCDC's main.c, built for the PC and run in real time behind two pseudo-terminals,
+    so that cdcbench.c (or anything else) can use it as it would the adapter
+
+    main.c is built with -DRINGSIM (see ringsim.h), as for ringsim.c, but rather than
+    checking the rings against a pattern, everything around main.c is wired to a pty:
+    - the "device" pty is the adapter's COM port: what the PC writes to it fills the
+      armed EP2 OUT buffers, and EP2 IN packets are written to it as main() sends them;
+      the PC exchanges packets with EP2 every HOST_NS, as a host controller polls bulk
+      endpoints many times per frame, and a start-of-frame comes every 1 ms
+    - the "wire" pty is the far end of the USART: a byte completes on RX every ten bit
+      times while it has something to send (through the PIC's two byte receive FIFO,
+      overrunning if isr() falls behind), and each byte the USART sends is written to it
+    - every USB call main() makes takes STUB_NS of simulated time, which is kept within
+      PACE_NS of the wall clock; the firmware's own execution time is not modelled
+
+    so the coalescing of USART data into IN packets is main.c's own, as configured by
+    usart.h and any -D overrides of it; the device and wire pty paths are printed on
+    stdout, and once stdin is closed, the number of IN packets sent and of USART overruns
+
+    gcc -O2 -Wall -D__XC8 -DRINGSIM -I. -Iinclude -o ptysim ptysim.c main.c
+    ./ptysim [<baud>]
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include "ringsim.h"
+#include "usb.h"
+#include "usart.h"
+
+/* only main.c's main() is renamed */
+#undef main
+
+#define STUB_NS			2000ULL
+#define HOST_NS			100000ULL
+#define FRAME_NS		1000000ULL
+#define PACE_NS			100000ULL
+#define RX_FIFO_LEN		2
+#define EP2_BUFFERS		2
+#define WIRE_CHUNK		64
+
+int usart_main(void);
+void isr(void);
+
+/* the registers of ringsim.h */
+volatile ringsim_PIR1bits_t PIR1bits;
+volatile ringsim_PIE1bits_t PIE1bits;
+volatile ringsim_RCSTAbits_t RCSTAbits;
+volatile ringsim_TXSTAbits_t TXSTAbits;
+volatile ringsim_INTCONbits_t INTCONbits;
+volatile ringsim_LATCbits_t LATCbits;
+volatile ringsim_TRISCbits_t TRISCbits;
+volatile ringsim_ANSELCbits_t ANSELCbits;
+volatile ringsim_PORTCbits_t PORTCbits;
+volatile uint8_t TXSTA, RCSTA, BAUDCON, SPBRGH, SPBRG;
+volatile uint16_t ringsim_txreg = RINGSIM_TXREG_EMPTY;
+
+static struct
+{
+	unsigned long long now, byte_ns, next_host, next_frame, next_rx, tsr_done;
+	struct timespec start;
+	bool sof_pending;
+	int device, wire;
+
+	/* USART RX: bytes read from the wire, still to complete, and those in the FIFO */
+	uint8_t wire_buf[WIRE_CHUNK];
+	unsigned wire_head, wire_count;
+	uint8_t rx_fifo[RX_FIFO_LEN];
+	unsigned rx_count;
+	unsigned long rx_overruns;
+
+	/* USART TX */
+	uint8_t txreg, tsr;
+	bool txreg_full, tsr_busy;
+	unsigned long tx_lost;
+
+	/* EP2 IN packets queued for the PC, and the part of the oldest it has already taken */
+	uint8_t in_buf[EP2_BUFFERS][EP_2_IN_LEN];
+	unsigned in_len[EP2_BUFFERS], in_head, in_count, in_taken;
+	unsigned long in_packets;
+
+	/* EP2 OUT buffers, filled by the PC whenever they are armed */
+	uint8_t out_buf[EP2_BUFFERS][EP_2_OUT_LEN];
+	unsigned out_len[EP2_BUFFERS], out_head, out_fill;
+	bool out_full[EP2_BUFFERS];
+
+	uint8_t ep1_buf[EP_1_IN_LEN];
+} sim;
+
+static jmp_buf finished;
+
+/* the master side of a new pseudo-terminal; its slave is set raw, and kept open so reads never fail */
+static int open_pty(char **path)
+{
+	struct termios tio;
+	int master, slave;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ( (master < 0) || grantpt(master) || unlockpt(master) )
+		return -1;
+
+	*path = strdup(ptsname(master));
+	slave = open(*path, O_RDWR | O_NOCTTY);
+	if ( (slave < 0) || tcgetattr(slave, &tio) )
+		return -1;
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	fcntl(master, F_SETFL, O_NONBLOCK);
+
+	return master;
+}
+
+static unsigned long long wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (ts.tv_sec - sim.start.tv_sec) * 1000000000ULL + ts.tv_nsec - sim.start.tv_nsec;
+}
+
+static void start_tsr(void)
+{
+	sim.tsr = sim.txreg;
+	sim.txreg_full = false;
+	sim.tsr_busy = true;
+	sim.tsr_done = sim.now + sim.byte_ns;
+	PIR1bits.TXIF = 1;
+	TXSTAbits.TRMT = 0;
+}
+
+uint8_t ringsim_rcreg(void)
+{
+	uint8_t rx;
+
+	if (0 == sim.rx_count)
+		return 0;
+	rx = sim.rx_fifo[0];
+	memmove(sim.rx_fifo, sim.rx_fifo + 1, --sim.rx_count);
+	PIR1bits.RCIF = (sim.rx_count > 0);
+	return rx;
+}
+
+static void take_interrupts(void)
+{
+	while (INTCONbits.GIE && INTCONbits.PEIE &&
+		((PIE1bits.RCIE && PIR1bits.RCIF) || (PIE1bits.TXIE && PIR1bits.TXIF)))
+	{
+		ringsim_txreg = RINGSIM_TXREG_EMPTY;
+		isr();
+		/* isr() toggles CREN whenever it sees OERR, which clears it */
+		RCSTAbits.OERR = 0;
+		if (RINGSIM_TXREG_EMPTY != ringsim_txreg)
+		{
+			sim.txreg = (uint8_t)ringsim_txreg;
+			sim.txreg_full = true;
+			PIR1bits.TXIF = 0;
+			if (!sim.tsr_busy)
+				start_tsr();
+		}
+	}
+}
+
+/* the PC's side of EP2: take the IN packets it has room for, and fill the armed OUT buffers */
+static void host(void)
+{
+	unsigned len;
+	ssize_t got;
+
+	while (sim.in_count)
+	{
+		len = sim.in_len[sim.in_head] - sim.in_taken;
+		got = len ? write(sim.device, sim.in_buf[sim.in_head] + sim.in_taken, len) : 0;
+		if (got < 0)
+			break;
+		sim.in_taken += got;
+		if (sim.in_taken < sim.in_len[sim.in_head])
+			break;
+		sim.in_taken = 0;
+		sim.in_head = (sim.in_head + 1) % EP2_BUFFERS;
+		sim.in_count--;
+	}
+
+	while (!sim.out_full[sim.out_fill])
+	{
+		got = read(sim.device, sim.out_buf[sim.out_fill], EP_2_OUT_LEN);
+		if (got <= 0)
+			break;
+		sim.out_len[sim.out_fill] = got;
+		sim.out_full[sim.out_fill] = true;
+		sim.out_fill = (sim.out_fill + 1) % EP2_BUFFERS;
+	}
+
+	sim.next_host += HOST_NS;
+}
+
+/* a start-of-frame; this is also when stdin is checked for the end of the run */
+static void frame(void)
+{
+	struct pollfd pfd;
+	char c;
+
+	sim.sof_pending = true;
+
+	pfd.fd = STDIN_FILENO;
+	pfd.events = POLLIN;
+	if ( (poll(&pfd, 1, 0) > 0) && (read(STDIN_FILENO, &c, 1) <= 0) )
+		longjmp(finished, 1);
+
+	sim.next_frame += FRAME_NS;
+}
+
+/* the next byte from the far end, into the receive FIFO; an idle line is looked at again a byte time later */
+static void receive(void)
+{
+	ssize_t got;
+
+	if (0 == sim.wire_count)
+	{
+		got = read(sim.wire, sim.wire_buf, sizeof(sim.wire_buf));
+		sim.wire_head = 0;
+		sim.wire_count = (got > 0) ? got : 0;
+	}
+
+	if (sim.wire_count)
+	{
+		if (sim.rx_count < RX_FIFO_LEN)
+			sim.rx_fifo[sim.rx_count++] = sim.wire_buf[sim.wire_head];
+		else
+			sim.rx_overruns++, RCSTAbits.OERR = 1;
+		PIR1bits.RCIF = 1;
+		sim.wire_head++;
+		sim.wire_count--;
+	}
+
+	sim.next_rx += sim.byte_ns;
+}
+
+/* advance simulated time to end, calling isr() as the USART needs it, and then let the wall clock catch up */
+static void run_until(unsigned long long end)
+{
+	unsigned long long t, wall;
+	struct timespec ts;
+
+	for (;;)
+	{
+		take_interrupts();
+
+		t = sim.next_host;
+		if (sim.next_frame < t)
+			t = sim.next_frame;
+		if (sim.next_rx < t)
+			t = sim.next_rx;
+		if (sim.tsr_busy && (sim.tsr_done < t))
+			t = sim.tsr_done;
+		if (t > end)
+			break;
+		sim.now = t;
+
+		if (sim.next_rx == t)
+			receive();
+
+		if (sim.tsr_busy && (sim.tsr_done == t))
+		{
+			if (write(sim.wire, &sim.tsr, 1) != 1)
+				sim.tx_lost++;
+			sim.tsr_busy = false;
+			TXSTAbits.TRMT = 1;
+			if (sim.txreg_full)
+				start_tsr();
+		}
+
+		if (sim.next_host == t)
+			host();
+
+		if (sim.next_frame == t)
+			frame();
+	}
+
+	sim.now = end;
+
+	wall = wall_ns();
+	if (sim.now > wall + PACE_NS)
+	{
+		ts.tv_sec = (sim.now - wall) / 1000000000ULL;
+		ts.tv_nsec = (sim.now - wall) % 1000000000ULL;
+		nanosleep(&ts, NULL);
+	}
+}
+
+static void step(void)
+{
+	run_until(sim.now + STUB_NS);
+}
+
+/* the M-Stack calls main.c makes */
+
+void usb_init(void)
+{
+}
+
+void usb_service(void)
+{
+	step();
+
+	if (sim.sof_pending)
+	{
+		sim.sof_pending = false;
+		USARTStartOfFrame();
+	}
+}
+
+uint8_t usb_get_configuration(void)
+{
+	return 1;
+}
+
+unsigned char *usb_get_in_buffer(uint8_t endpoint)
+{
+	step();
+	if (2 != endpoint)
+		return sim.ep1_buf;
+	return sim.in_buf[(sim.in_head + sim.in_count) % EP2_BUFFERS];
+}
+
+void usb_send_in_buffer(uint8_t endpoint, size_t len)
+{
+	step();
+	if (2 != endpoint)
+		return;
+	sim.in_len[(sim.in_head + sim.in_count) % EP2_BUFFERS] = len;
+	sim.in_count++;
+	sim.in_packets++;
+}
+
+bool usb_in_endpoint_busy(uint8_t endpoint)
+{
+	step();
+	return (2 == endpoint) && (EP2_BUFFERS == sim.in_count);
+}
+
+bool usb_in_endpoint_halted(uint8_t endpoint)
+{
+	(void)endpoint;
+	return false;
+}
+
+bool usb_out_endpoint_has_data(uint8_t endpoint)
+{
+	(void)endpoint;
+	step();
+	return sim.out_full[sim.out_head];
+}
+
+uint8_t usb_get_out_buffer(uint8_t endpoint, const unsigned char **buffer)
+{
+	(void)endpoint;
+	step();
+	*buffer = sim.out_buf[sim.out_head];
+	return sim.out_len[sim.out_head];
+}
+
+void usb_arm_out_endpoint(uint8_t endpoint)
+{
+	(void)endpoint;
+	step();
+	sim.out_full[sim.out_head] = false;
+	sim.out_head = (sim.out_head + 1) % EP2_BUFFERS;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long baud = (argc > 1) ? strtoul(argv[1], NULL, 0) : USART_DEFAULT_BPS;
+	char *device_path, *wire_path;
+
+	if ( (argc > 2) || (baud < 300) )
+	{
+		fprintf(stderr, "%s [<baud>]\n", argv[0]);
+		return -1;
+	}
+
+	memset(&sim, 0, sizeof(sim));
+	PIR1bits.TXIF = 1;
+	TXSTAbits.TRMT = 1;
+
+	sim.device = open_pty(&device_path);
+	sim.wire = open_pty(&wire_path);
+	if ( (sim.device < 0) || (sim.wire < 0) )
+	{
+		fprintf(stderr, "ERROR: unable to create pseudo-terminal\n");
+		return -1;
+	}
+
+	printf("%s %s\n", device_path, wire_path);
+	fflush(stdout);
+
+	sim.byte_ns = 10ULL * 1000000000ULL / baud;
+	sim.next_host = HOST_NS;
+	sim.next_frame = FRAME_NS;
+	sim.next_rx = sim.byte_ns;
+	clock_gettime(CLOCK_MONOTONIC, &sim.start);
+
+	if (0 == setjmp(finished))
+		usart_main();
+
+	printf("%lu IN packets, %lu USART overruns, %lu bytes lost on TX\n", sim.in_packets, sim.rx_overruns, sim.tx_lost);
+
+	return 0;
+}
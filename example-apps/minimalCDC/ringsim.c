@@ -0,0 +1,404 @@
+/*
+    host-side stress test of minimalCDC's USART ring buffers
+
+    main.c itself is built for the PC (with -DRINGSIM; see ringsim.h) and run
+    against a simulation of everything around it:
+    - a byte completes on RX every ten bit times at the given baud rate, and
+      one leaves TX every ten bit times while there is data to send, through
+      the PIC's two byte receive FIFO and its TXREG/shift register pair;
+      isr() is called whenever RCIF, or TXIF with TXIE, is set and GIE allows
+    - usb_service() takes as long as told, which is the point of the test:
+      the rings have to carry the USART through it; the start-of-frame
+      callback runs at most once per call, as M-Stack only sees SOFIF once
+    - EP2 IN and OUT are ping-ponged, as in usb_config.h; the PC takes at
+      most one IN packet, and fills each armed OUT buffer at most once, per
+      1 ms frame, which is slower than a real host
+    - every other USB call main() makes takes STUB_NS, so that isr() also
+      runs in between the steps of the main loop
+
+    each run streams STREAM_BYTES of a pseudo-random pattern both ways at
+    once, at the full line rate, and checks that every byte arrives, in order
+
+    gcc -O2 -Wall -D__XC8 -DRINGSIM -I. -Iinclude -o ringsim ringsim.c main.c
+    ./ringsim [<baud> <usb_service() time in us>] ...
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include "ringsim.h"
+#include "usb.h"
+#include "usart.h"
+
+/* only main.c's main() is renamed */
+#undef main
+
+#define STREAM_BYTES	65536UL
+#define STUB_NS			2000ULL
+#define FRAME_NS		1000000ULL
+/* once both streams have been sent, give up on bytes that haven't arrived after this long */
+#define DRAIN_NS		(50 * FRAME_NS)
+#define RX_FIFO_LEN		2
+#define EP2_BUFFERS		2
+
+#define RX_SEED			0x5A
+#define TX_SEED			0xC3
+
+int usart_main(void);
+void isr(void);
+
+/* the registers of ringsim.h */
+volatile ringsim_PIR1bits_t PIR1bits;
+volatile ringsim_PIE1bits_t PIE1bits;
+volatile ringsim_RCSTAbits_t RCSTAbits;
+volatile ringsim_TXSTAbits_t TXSTAbits;
+volatile ringsim_INTCONbits_t INTCONbits;
+volatile ringsim_LATCbits_t LATCbits;
+volatile ringsim_TRISCbits_t TRISCbits;
+volatile ringsim_ANSELCbits_t ANSELCbits;
+volatile ringsim_PORTCbits_t PORTCbits;
+volatile uint8_t TXSTA, RCSTA, BAUDCON, SPBRGH, SPBRG;
+volatile uint16_t ringsim_txreg = RINGSIM_TXREG_EMPTY;
+
+static struct
+{
+	unsigned long long now, byte_ns, service_ns, next_frame, next_rx, tsr_done, last_progress;
+	bool sof_pending;
+
+	/* USART RX: the target's bytes, on their way to the PC */
+	unsigned long rx_sent, rx_overruns;
+	uint8_t rx_fifo[RX_FIFO_LEN];
+	unsigned rx_count;
+
+	/* USART TX: the PC's bytes, once they have left the shift register */
+	uint8_t txreg, tsr;
+	bool txreg_full, tsr_busy;
+	unsigned long tx_received, tx_errors;
+
+	/* EP2 IN packets queued for the PC, and what it has made of them */
+	uint8_t in_buf[EP2_BUFFERS][EP_2_IN_LEN];
+	unsigned in_len[EP2_BUFFERS], in_head, in_count;
+	unsigned long in_received, in_errors, max_held;
+
+	/* EP2 OUT buffers, filled by the PC whenever they are armed */
+	uint8_t out_buf[EP2_BUFFERS][EP_2_OUT_LEN];
+	unsigned out_len[EP2_BUFFERS], out_head, out_fill;
+	bool out_full[EP2_BUFFERS];
+	unsigned long out_sent;
+
+	uint8_t ep1_buf[EP_1_IN_LEN];
+	unsigned long notifications;
+} sim;
+
+static jmp_buf finished;
+
+static uint8_t pattern(uint8_t seed, unsigned long i)
+{
+	return (uint8_t)(((i + seed) * 2654435761UL) >> 13);
+}
+
+static void start_tsr(void)
+{
+	sim.tsr = sim.txreg;
+	sim.txreg_full = false;
+	sim.tsr_busy = true;
+	sim.tsr_done = sim.now + sim.byte_ns;
+	PIR1bits.TXIF = 1;
+	TXSTAbits.TRMT = 0;
+}
+
+uint8_t ringsim_rcreg(void)
+{
+	uint8_t rx;
+
+	if (0 == sim.rx_count)
+		return 0;
+	rx = sim.rx_fifo[0];
+	memmove(sim.rx_fifo, sim.rx_fifo + 1, --sim.rx_count);
+	PIR1bits.RCIF = (sim.rx_count > 0);
+	return rx;
+}
+
+static void take_interrupts(void)
+{
+	while (INTCONbits.GIE && INTCONbits.PEIE &&
+		((PIE1bits.RCIE && PIR1bits.RCIF) || (PIE1bits.TXIE && PIR1bits.TXIF)))
+	{
+		ringsim_txreg = RINGSIM_TXREG_EMPTY;
+		isr();
+		/* isr() toggles CREN whenever it sees OERR, which clears it */
+		RCSTAbits.OERR = 0;
+		if (RINGSIM_TXREG_EMPTY != ringsim_txreg)
+		{
+			sim.txreg = (uint8_t)ringsim_txreg;
+			sim.txreg_full = true;
+			PIR1bits.TXIF = 0;
+			if (!sim.tsr_busy)
+				start_tsr();
+		}
+	}
+}
+
+/* the PC's side of a USB frame: take an IN packet, and fill the armed OUT buffers */
+static void frame(void)
+{
+	unsigned i, len;
+
+	sim.sof_pending = true;
+
+	if (sim.in_count)
+	{
+		for (i = 0; i < sim.in_len[sim.in_head]; i++)
+		{
+			if (pattern(RX_SEED, sim.in_received) != sim.in_buf[sim.in_head][i])
+				sim.in_errors++;
+			sim.in_received++;
+		}
+		sim.in_head = (sim.in_head + 1) % EP2_BUFFERS;
+		sim.in_count--;
+		sim.last_progress = sim.now;
+	}
+
+	while (!sim.out_full[sim.out_fill] && (sim.out_sent < STREAM_BYTES))
+	{
+		len = (STREAM_BYTES - sim.out_sent < EP_2_OUT_LEN) ? STREAM_BYTES - sim.out_sent : EP_2_OUT_LEN;
+		for (i = 0; i < len; i++)
+			sim.out_buf[sim.out_fill][i] = pattern(TX_SEED, sim.out_sent++);
+		sim.out_len[sim.out_fill] = len;
+		sim.out_full[sim.out_fill] = true;
+		sim.out_fill = (sim.out_fill + 1) % EP2_BUFFERS;
+	}
+
+	sim.next_frame += FRAME_NS;
+}
+
+/* advance simulated time to end, calling isr() as the USART needs it */
+static void run_until(unsigned long long end)
+{
+	unsigned long long t;
+	unsigned long held;
+
+	for (;;)
+	{
+		take_interrupts();
+
+		t = sim.next_frame;
+		if ((sim.rx_sent < STREAM_BYTES) && (sim.next_rx < t))
+			t = sim.next_rx;
+		if (sim.tsr_busy && (sim.tsr_done < t))
+			t = sim.tsr_done;
+		if (t > end)
+			break;
+		sim.now = t;
+
+		if ((sim.rx_sent < STREAM_BYTES) && (sim.next_rx == t))
+		{
+			if (sim.rx_count < RX_FIFO_LEN)
+				sim.rx_fifo[sim.rx_count++] = pattern(RX_SEED, sim.rx_sent);
+			else
+				sim.rx_overruns++, RCSTAbits.OERR = 1;
+			PIR1bits.RCIF = 1;
+			sim.rx_sent++;
+			sim.next_rx += sim.byte_ns;
+		}
+
+		if (sim.tsr_busy && (sim.tsr_done == t))
+		{
+			if (pattern(TX_SEED, sim.tx_received) != sim.tsr)
+				sim.tx_errors++;
+			sim.tx_received++;
+			sim.last_progress = t;
+			sim.tsr_busy = false;
+			TXSTAbits.TRMT = 1;
+			if (sim.txreg_full)
+				start_tsr();
+		}
+
+		if (sim.next_frame == t)
+			frame();
+
+		/* bytes received but not yet with the PC are in the FIFO, the ring, or an IN buffer */
+		held = sim.rx_sent - sim.in_received;
+		if (held > sim.max_held)
+			sim.max_held = held;
+	}
+
+	sim.now = end;
+}
+
+static void step(void)
+{
+	run_until(sim.now + STUB_NS);
+}
+
+/* the M-Stack calls main.c makes */
+
+void usb_init(void)
+{
+}
+
+void usb_service(void)
+{
+	run_until(sim.now + sim.service_ns);
+
+	if (sim.sof_pending)
+	{
+		sim.sof_pending = false;
+		USARTStartOfFrame();
+	}
+
+	if ((sim.in_received == STREAM_BYTES) && (sim.tx_received == STREAM_BYTES))
+		longjmp(finished, 1);
+	if ((sim.rx_sent == STREAM_BYTES) && (sim.out_sent == STREAM_BYTES) && (sim.now - sim.last_progress > DRAIN_NS))
+		longjmp(finished, 1);
+}
+
+uint8_t usb_get_configuration(void)
+{
+	return 1;
+}
+
+unsigned char *usb_get_in_buffer(uint8_t endpoint)
+{
+	step();
+	if (2 != endpoint)
+		return sim.ep1_buf;
+	return sim.in_buf[(sim.in_head + sim.in_count) % EP2_BUFFERS];
+}
+
+void usb_send_in_buffer(uint8_t endpoint, size_t len)
+{
+	step();
+	if (2 != endpoint)
+	{
+		sim.notifications++;
+		return;
+	}
+	sim.in_len[(sim.in_head + sim.in_count) % EP2_BUFFERS] = len;
+	sim.in_count++;
+}
+
+bool usb_in_endpoint_busy(uint8_t endpoint)
+{
+	step();
+	return (2 == endpoint) && (EP2_BUFFERS == sim.in_count);
+}
+
+bool usb_in_endpoint_halted(uint8_t endpoint)
+{
+	(void)endpoint;
+	return false;
+}
+
+bool usb_out_endpoint_has_data(uint8_t endpoint)
+{
+	(void)endpoint;
+	step();
+	return sim.out_full[sim.out_head];
+}
+
+uint8_t usb_get_out_buffer(uint8_t endpoint, const unsigned char **buffer)
+{
+	(void)endpoint;
+	step();
+	*buffer = sim.out_buf[sim.out_head];
+	return sim.out_len[sim.out_head];
+}
+
+void usb_arm_out_endpoint(uint8_t endpoint)
+{
+	(void)endpoint;
+	step();
+	sim.out_full[sim.out_head] = false;
+	sim.out_head = (sim.out_head + 1) % EP2_BUFFERS;
+}
+
+static int run(unsigned long baud, unsigned long service_us)
+{
+	double seconds;
+	bool ok;
+
+	memset(&sim, 0, sizeof(sim));
+	memset((void *)&PIR1bits, 0, sizeof(PIR1bits));
+	memset((void *)&PIE1bits, 0, sizeof(PIE1bits));
+	memset((void *)&INTCONbits, 0, sizeof(INTCONbits));
+	PIR1bits.TXIF = 1;
+	TXSTAbits.TRMT = 1;
+
+	sim.byte_ns = 10ULL * 1000000000ULL / baud;
+	sim.service_ns = 1000ULL * service_us;
+	sim.next_frame = FRAME_NS;
+	/* the target starts sending a little after power-up, once the USART is set up */
+	sim.next_rx = 100000;
+
+	if (0 == setjmp(finished))
+		usart_main();
+
+	seconds = sim.now / 1e9;
+	ok = (STREAM_BYTES == sim.in_received) && !sim.in_errors && (STREAM_BYTES == sim.tx_received) && !sim.tx_errors;
+
+	printf("%s %7lu bps, usb_service() %5lu us: %5.2f s; RX->PC %lu/%lu bytes (%lu wrong, most held %lu of the %u buffered), PC->TX %lu/%lu bytes (%lu wrong), %.0f%% of the line rate\n",
+		ok ? "ok  " : "FAIL", baud, service_us, seconds,
+		sim.in_received, STREAM_BYTES, sim.in_errors, sim.max_held, RX_FIFO_LEN + 128 + EP2_BUFFERS * (EP_2_IN_LEN - 1),
+		sim.tx_received, STREAM_BYTES, sim.tx_errors, 100.0 * sim.tx_received * sim.byte_ns / sim.now);
+	if (sim.rx_overruns || sim.notifications)
+		printf("     %lu USART overruns, %lu SERIAL_STATE notifications\n", sim.rx_overruns, sim.notifications);
+
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	/*
+	usb_service() passes close to the slowest each rate allows: main() sends at most one
+	63 byte IN packet per pass, so a pass has to take less than 63 byte times
+	*/
+	static const unsigned long runs[][2] =
+	{
+		{ 115200, 1000 }, { 115200, 4000 }, { 115200, 5000 },
+		{ 230400, 2000 }, { 460800, 1000 },
+	};
+	unsigned i;
+	int failures = 0;
+
+	if ((argc > 1) && (argc % 2 == 1))
+	{
+		for (i = 1; i < (unsigned)argc; i += 2)
+			failures += run(strtoul(argv[i], NULL, 0), strtoul(argv[i + 1], NULL, 0));
+	}
+	else if (argc > 1)
+	{
+		fprintf(stderr, "%s [<baud> <usb_service() time in us>] ...\n", argv[0]);
+		return -1;
+	}
+	else
+	{
+		for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++)
+			failures += run(runs[i][0], runs[i][1]);
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,46 @@
+/*
+    host build of minimalCDC's main.c, for ringsim.c and ptysim.c
+
+    stands in for <xc.h> when main.c is built with -DRINGSIM: the USART,
+    interrupt and port registers that main.c touches become variables, which
+    ringsim.c or ptysim.c updates as the simulated USART sends and receives
+*/
+
+#ifndef RINGSIM_H__
+#define RINGSIM_H__
+
+#include <stdint.h>
+
+/* isr() is called by the simulation, and ringsim.c has the real main() */
+#define interrupt
+#define main usart_main
+
+typedef struct { unsigned TXIF:1; unsigned RCIF:1; } ringsim_PIR1bits_t;
+typedef struct { unsigned TXIE:1; unsigned RCIE:1; } ringsim_PIE1bits_t;
+typedef struct { unsigned OERR:1; unsigned FERR:1; unsigned CREN:1; } ringsim_RCSTAbits_t;
+typedef struct { unsigned TRMT:1; unsigned BRGH:1; unsigned TXEN:1; } ringsim_TXSTAbits_t;
+typedef struct { unsigned PEIE:1; unsigned GIE:1; } ringsim_INTCONbits_t;
+typedef struct { unsigned LATC1:1; unsigned LATC3:1; unsigned LATC4:1; } ringsim_LATCbits_t;
+typedef struct { unsigned TRISC1:1; unsigned TRISC2:1; unsigned TRISC3:1; unsigned TRISC4:1; unsigned TRISC5:1; } ringsim_TRISCbits_t;
+typedef struct { unsigned ANSC1:1; unsigned ANSC2:1; unsigned ANSC3:1; } ringsim_ANSELCbits_t;
+typedef struct { unsigned RC2:1; } ringsim_PORTCbits_t;
+
+extern volatile ringsim_PIR1bits_t PIR1bits;
+extern volatile ringsim_PIE1bits_t PIE1bits;
+extern volatile ringsim_RCSTAbits_t RCSTAbits;
+extern volatile ringsim_TXSTAbits_t TXSTAbits;
+extern volatile ringsim_INTCONbits_t INTCONbits;
+extern volatile ringsim_LATCbits_t LATCbits;
+extern volatile ringsim_TRISCbits_t TRISCbits;
+extern volatile ringsim_ANSELCbits_t ANSELCbits;
+extern volatile ringsim_PORTCbits_t PORTCbits;
+extern volatile uint8_t TXSTA, RCSTA, BAUDCON, SPBRGH, SPBRG;
+
+/* reading RCREG takes a byte from the receive FIFO; TXREG holds RINGSIM_TXREG_EMPTY until written */
+#define RINGSIM_TXREG_EMPTY 0xFFFF
+#define RCREG ringsim_rcreg()
+#define TXREG ringsim_txreg
+uint8_t ringsim_rcreg(void);
+extern volatile uint16_t ringsim_txreg;
+
+#endif /* RINGSIM_H__ */
@@ -0,0 +1,185 @@
+/*
+    host timing of the CDC class request dispatch in usb_cdc.c
+
+    builds usb_cdc.c, with this example's usb_config.h, against stubs for the
+    rest of the stack and for the application callbacks, then times
+    process_cdc_setup_request() on each ACM request and on a few it must STALL
+
+    two figures are given for each: the instructions executed, counted by
+    single-stepping a child process through the call (less those of an empty
+    call), and the time taken; both are host figures, not PIC cycles, and are
+    for comparing one version of the dispatch with another built the same way
+    (-O0 being the nearest to how XC8's free mode treats the code); the
+    instruction count is the steadier of the two, and on the PIC, where nearly
+    every instruction takes one cycle, the closer to what matters
+
+    build (Linux): gcc -O0 -Wall -Wno-unknown-pragmas -D__XC8 -fpack-struct '-Dmin(x,y)=(((x)<(y))?(x):(y))' -I. -Iinclude -o setupsim setupsim.c usb_cdc.c
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include "usb.h"
+#include "usb_ch9.h"
+#include "usb_cdc.h"
+
+#define REPEAT 1000000
+
+struct test
+{
+	const char *name;
+	uint8_t request_type;
+	uint8_t request;
+	uint16_t value;
+	uint8_t stalls; /* expected outcome, with this example's usb_config.h */
+};
+
+static const struct test tests[] =
+{
+	{ "SEND_ENCAPSULATED_COMMAND", 0x21, CDC_SEND_ENCAPSULATED_COMMAND, 0, 1 },
+	{ "SET_LINE_CODING", 0x21, CDC_SET_LINE_CODING, 0, 0 },
+	{ "GET_LINE_CODING", 0xa1, CDC_GET_LINE_CODING, 0, 0 },
+	{ "SET_CONTROL_LINE_STATE", 0x21, CDC_SET_CONTROL_LINE_STATE, 3, 0 },
+	{ "SEND_BREAK", 0x21, CDC_SEND_BREAK, 0, 0 },
+	{ "SEND_BREAK, wrong bmRequestType", 0xa1, CDC_SEND_BREAK, 0, 1 },
+	{ "unknown (0x7F)", 0x21, 0x7F, 0, 1 },
+};
+
+static unsigned long data_stages;
+
+void usb_start_receive_ep0_data_stage(char *buffer, size_t len, usb_ep0_data_stage_callback callback, void *context)
+{
+	data_stages++;
+}
+
+void usb_send_data_stage(char *buffer, size_t len, usb_ep0_data_stage_callback callback, void *context)
+{
+	data_stages++;
+}
+
+void app_set_line_coding_callback(uint8_t interface, const struct cdc_line_coding *coding)
+{
+}
+
+int8_t app_get_line_coding_callback(uint8_t interface, struct cdc_line_coding *coding)
+{
+	return 0;
+}
+
+int8_t app_set_control_line_state_callback(uint8_t interface, bool dtr, bool dts)
+{
+	return 0;
+}
+
+int8_t app_send_break_callback(uint8_t interface, uint16_t duration)
+{
+	return 0;
+}
+
+static uint8_t no_request(const struct setup_packet *setup)
+{
+	return 0;
+}
+
+/* instructions executed by one call to process(), counted by single-stepping a child that makes it */
+static long count_instructions(uint8_t (*process)(const struct setup_packet *setup), const struct setup_packet *setup)
+{
+	pid_t child;
+	int status;
+	long steps = 0;
+
+	child = fork();
+	if (0 == child)
+	{
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		raise(SIGSTOP);
+		process(setup);
+		_exit(0);
+	}
+	if (child < 0)
+		return -1;
+
+	waitpid(child, &status, 0);
+	while (WIFSTOPPED(status))
+	{
+		if (ptrace(PTRACE_SINGLESTEP, child, NULL, NULL) < 0)
+			return -1;
+		waitpid(child, &status, 0);
+		steps++;
+	}
+
+	return steps;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+	struct setup_packet setup;
+	unsigned index, count;
+	uint8_t result = 0;
+	double start, elapsed;
+	long overhead, steps;
+	int failed = 0;
+
+	/* what it takes to get into and out of the child, and to make any call at all */
+	memset(&setup, 0, sizeof(setup));
+	overhead = count_instructions(no_request, &setup);
+
+	for (index = 0; index < sizeof(tests) / sizeof(tests[0]); index++)
+	{
+		memset(&setup, 0, sizeof(setup));
+		setup.REQUEST.bmRequestType = tests[index].request_type;
+		setup.bRequest = tests[index].request;
+		setup.wValue = tests[index].value;
+		setup.wLength = sizeof(struct cdc_line_coding);
+
+		steps = count_instructions(process_cdc_setup_request, &setup) - overhead;
+
+		start = now();
+		for (count = 0; count < REPEAT; count++)
+			result = process_cdc_setup_request(&setup);
+		elapsed = now() - start;
+
+		printf("%-32s %s  %4ld instructions  %5.1f ns\n", tests[index].name, (0 == result) ? "handled" : "STALL  ", steps, elapsed * 1e9 / REPEAT);
+
+		if ((0 != result) != tests[index].stalls)
+			failed = 1;
+	}
+
+	if (failed)
+		fprintf(stderr, "ERROR: a request was not handled as usb_config.h expects\n");
+
+	return failed;
+}
@@ -0,0 +1,91 @@
+/*
+    USART interface shared between main.c and the USB callbacks in usb_helpers.c
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef USART_H__
+#define USART_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    optional hardware flow control; RTS is an output on RC3 and CTS an input on RC2, both active low
+    RTS is asserted while the host has raised RTS *and* the USART->USB ring has room
+    bytes are only fed to TXREG while the target asserts CTS
+*/
+//#define USART_RTS_CTS
+
+/*
+    modem control outputs, active low like those of an FTDI adapter: DTR on RC1 follows the host's DTR, and
+    (unless USART_RTS_CTS claims it for flow control) RTS on RC3 follows the host's RTS
+    e.g. an Arduino-style target can be reset through a capacitor from DTR; comment out to leave the pins alone
+*/
+#define USART_DTR_RTS
+
+/*
+    coalescing of USART->USB data; a short packet is only sent to the PC once
+    - the data pending would fill a packet, or
+    - CDC_FLUSH_FRAMES USB frames (ms) have started with data pending, or
+    - CDC_FLUSH_DELIMITER has been received (comment out to disable)
+    a CDC_FLUSH_FRAMES of zero sends whatever is pending as soon as EP2 IN is free
+    either can also be set from the command line, with -DCDC_NO_FLUSH_DELIMITER to disable the delimiter
+*/
+#ifndef CDC_FLUSH_FRAMES
+#define CDC_FLUSH_FRAMES 2
+#endif
+#if !defined(CDC_FLUSH_DELIMITER) && !defined(CDC_NO_FLUSH_DELIMITER)
+#define CDC_FLUSH_DELIMITER '\r'
+#endif
+
+/*
+    optional packetized mode; rather than a raw byte stream, the PC receives USART data as frames of
+    a length byte followed by that many payload bytes, packed back to back across USB packets
+    a frame ends at CDC_FLUSH_DELIMITER (which is not passed on), once it holds CDC_FRAME_MAX bytes,
+    or once CDC_FLUSH_FRAMES have passed; framedcdc.c is the matching PC-side decoder
+*/
+//#define CDC_FRAMED_MODE
+#define CDC_FRAME_MAX 120
+
+/* the power-up rate, until the host sends SET_LINE_CODING */
+#define USART_DEFAULT_BPS 115200UL
+
+/*
+    program the baud rate generator for the rate closest to bps;
+    returns the rate actually achieved, or 0 (leaving the USART untouched) if bps is unattainable
+*/
+uint32_t SetUSARTBaudRate(uint32_t bps);
+
+/* apply the DTR and RTS states requested by the host with SET_CONTROL_LINE_STATE */
+void SetUSARTControlLines(bool dtr, bool rts);
+
+/*
+    hold TX low for duration ms, as requested by the host with SEND_BREAK; the break starts with the next
+    USB frame once any byte in flight has gone, and lasts that many frames
+    a duration of 0xFFFF holds TX low until a duration of zero ends the break
+*/
+void SendUSARTBreak(uint16_t duration);
+
+/* advance the coalescing timeout; called from the USB start-of-frame callback */
+void USARTStartOfFrame(void);
+
+#endif /* USART_H__ */
@@ -41,28 +41,40 @@ STATIC_SIZE_CHECK_EQUAL(sizeof(struct cdc_serial_state_notification), 10);
 
 
 #ifdef MULTI_CLASS_DEVICE
-static uint8_t *cdc_interfaces;
-static uint8_t num_cdc_interfaces;
+#ifndef CDC_MAX_INTERFACES
+#define CDC_MAX_INTERFACES 16
+#endif
+
+/* Bitmap of the CDC interfaces, built once by cdc_set_interface_list() so
+ * that the per-request check is a single lookup rather than a walk of the
+ * interface list. */
+static uint8_t cdc_interface_map[(CDC_MAX_INTERFACES + 7) / 8];
+static const uint8_t interface_bit[8] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+};
 
 void cdc_set_interface_list(uint8_t *interfaces, uint8_t num_interfaces)
 {
-	cdc_interfaces = interfaces;
-	num_cdc_interfaces = num_interfaces;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(cdc_interface_map); i++)
+		cdc_interface_map[i] = 0;
+
+	for (i = 0; i < num_interfaces; i++) {
+		uint8_t interface = interfaces[i];
+		if (interface < CDC_MAX_INTERFACES)
+			cdc_interface_map[interface >> 3] |=
+				interface_bit[interface & 0x7];
+	}
 }
 
 static bool interface_is_cdc(uint8_t interface)
 {
-	uint8_t i;
-	for (i = 0; i < num_cdc_interfaces; i++) {
-		if (interface == cdc_interfaces[i])
-			break;
-	}
-
-	/* Return if interface is not in the list of CDC interfaces. */
-	if (i == num_cdc_interfaces)
+	if (interface >= CDC_MAX_INTERFACES)
 		return false;
 
-	return true;
+	return (cdc_interface_map[interface >> 3] &
+	        interface_bit[interface & 0x7]) != 0;
 }
 #endif
 
@@ -44,7 +44,9 @@
 
 #define NUMBER_OF_CONFIGURATIONS 1
 
-#define PPB_MODE PPB_NONE /* Do not ping-pong any endpoints */
+/* Ping-pong the non-zero endpoints, so EP2 can receive the next packet from
+   the PC while the previous one is still being copied into the USART ring */
+#define PPB_MODE PPB_EPN_ONLY
 
 //#define USB_USE_INTERRUPTS
 
@@ -76,7 +78,7 @@
 //#define CDC_GET_COMM_FEATURE_CALLBACK app_get_comm_feature_callback
 #define CDC_SET_LINE_CODING_CALLBACK app_set_line_coding_callback
 #define CDC_GET_LINE_CODING_CALLBACK app_get_line_coding_callback
-//#define CDC_SET_CONTROL_LINE_STATE_CALLBACK app_set_control_line_state_callback
-//#define CDC_SEND_BREAK_CALLBACK app_send_break_callback
+#define CDC_SET_CONTROL_LINE_STATE_CALLBACK app_set_control_line_state_callback
+#define CDC_SEND_BREAK_CALLBACK app_send_break_callback
 
 #endif /* USB_CONFIG_H__ */
@@ -121,8 +121,9 @@ static const ROMPTR struct configuration_1_packet configuration_1 =
 	bmCapabilities:
 	  Linux honors 0 (no capabilities) when said, but expects too much if any are advertised (so a value of zero is best)
 	  Windows ignores what is said here and expects CDC_SET_LINE_CODING_CALLBACK (and CDC_GET_LINE_CODING_CALLBACK) anyway
+	  Linux only passes on a break (tcsendbreak(), TIOCSBRK) when SEND_BREAK is advertised, which asks nothing more of us
 	*/
-	0,
+	CDC_ACM_CAPABILITY_SEND_BREAK,
 	},
 
 	/* CDC Union Functional Descriptor */
@@ -4,6 +4,16 @@
 #include "usb_config.h"
 #include "usb_ch9.h"
 #include "usb_cdc.h"
+#include "usart.h"
+
+/* line coding as last accepted from the host; the USART itself only does 8N1 */
+static struct cdc_line_coding line_coding =
+{
+	USART_DEFAULT_BPS,
+	CDC_CHAR_FORMAT_1_STOP_BIT,
+	CDC_PARITY_NONE,
+	8,
+};
 
 /* Callbacks. These function names are set in usb_config.h. */
 void app_set_configuration_callback(uint8_t configuration)
@@ -61,7 +71,7 @@ int16_t app_unknown_get_descriptor_callback(const struct setup_packet *pkt, cons
 
 void app_start_of_frame_callback(void)
 {
-
+	USARTStartOfFrame();
 }
 
 void app_usb_reset_callback(void)
@@ -108,23 +118,30 @@ int8_t app_get_comm_feature_callback(uint8_t interface,
 void app_set_line_coding_callback(uint8_t interface,
                                     const struct cdc_line_coding *coding)
 {
+	/* a rate the baud rate generator can't reach leaves the previous one in effect */
+	if (0 == SetUSARTBaudRate(coding->dwDTERate))
+		return;
 
+	line_coding.dwDTERate = coding->dwDTERate;
 }
 
 int8_t app_get_line_coding_callback(uint8_t interface,
                                     struct cdc_line_coding *coding)
 {
-	/* This is where baud rate, data, stop, and parity bits are set. */
-	return -1;
+	/* report the rate in effect, along with the only framing the USART is configured for */
+	*coding = line_coding;
+	return 0;
 }
 
 int8_t app_set_control_line_state_callback(uint8_t interface,
                                            bool dtr, bool dts)
 {
+	SetUSARTControlLines(dtr, dts);
 	return 0;
 }
 
 int8_t app_send_break_callback(uint8_t interface, uint16_t duration)
 {
+	SendUSARTBreak(duration);
 	return 0;
 }
@@ -308,6 +308,10 @@ extern int8_t HID_SET_PROTOCOL_CALLBACK(uint8_t interface, uint8_t protocol);
  * for multi-class composite devices to make sure that requests are not
  * confused between interfaces.  It should be called before usb_init().
  *
+ * The list is converted into a bitmap when this function is called, so
+ * it need not remain valid afterward.  Interface numbers must be less
+ * than HID_MAX_INTERFACES (default 16, may be set in usb_config.h).
+ *
  * @param interfaces      An array of interfaces which are HID class.
  * @param num_interfaces  The size of the @p interfaces array.
  */
@@ -26,7 +26,11 @@
 */
 
 #include "usb.h"
+#ifdef MOVESIM
+#include "movesim.h"
+#else
 #include <xc.h>
+#endif
 #include <string.h>
 #include "usb_config.h"
 #include "usb_ch9.h"
@@ -36,31 +40,44 @@
 since this is a downloaded app, configuration words (e.g. __CONFIG or #pragma config) are not relevant
 */
 
-/* counter incremented by USB SOF (Start Of Frame) to track approximate time between reports */
-static uint8_t tick_count;
-
-/* arbitrary mouse movement pattern to play back */
+/* arbitrary mouse movement pattern to play back, repeated endlessly */
 const int8_t move_table[]=
 {
 	/* 
-	X, Y, (at time 0)
-	X, Y, (at time 1)
-	X, Y, (at time 2)
+	X, Y, frames (move 0: X and Y counts, spread evenly over that many 1 ms USB frames; frames must be 1 or more)
+	X, Y, frames (move 1)
+	X, Y, frames (move 2)
 	...
 	*/
-	6, -2,
-	2, -6,
-	-2, -6,
-	-6, -2,
-	-6, 2,
-	-2, 6,
-	2, 6,
-	6, 2,
+	6, -2, 64,
+	2, -6, 64,
+	-2, -6, 64,
+	-6, -2, 64,
+	-6, 2, 64,
+	-2, 6, 64,
+	2, 6, 64,
+	6, 2, 64,
 };
 
+/*
+motion engine, advanced once per USB SOF (Start Of Frame) by app_start_of_frame_callback()
+the path is followed in 8.8 fixed point (1/256ths of a count), and whole counts are handed to main() as they build up,
+so that a report is only sent when there is movement to report, never an empty one
+*/
+static uint8_t move_index;     /* offset in move_table[] of the next move */
+static uint8_t frames_left;    /* frames of the current move yet to come */
+static int16_t step_x, step_y; /* movement per frame */
+static int16_t last_x, last_y; /* movement in the move's last frame, taking up what rounding step_x/step_y left out */
+static int16_t pos_x, pos_y;   /* movement not yet handed to main() */
+
+/* whole counts for main() to send, valid while report_ready is set */
+static int8_t report_x, report_y;
+static volatile uint8_t report_ready;
+
+static void MotionFrame(void);
+
 int main(void)
 {
-	uint8_t table_index = 0;
 	uint8_t *hid_report_in;
 
 #ifdef USB_USE_INTERRUPTS
@@ -82,32 +99,91 @@ int main(void)
 		if (!usb_is_configured())
 			continue;
 
+		/* proceed further only if there is movement to report */
+		if (!report_ready)
+			continue;
+
 		/* proceed further only if it is possible to send more data */
 		if (usb_in_endpoint_halted(1) || usb_in_endpoint_busy(1))
 			continue;
 
-		/* table_index modulus 16 *AND* make table_index an even number */
-		table_index &= 0xE;
-
 		/* build HID report */
 		hid_report_in[0] = 0;
-		if (tick_count > 63) /* if more than 64 ms has passed since the last report... */
-		{
-			tick_count = 0;
-			hid_report_in[1] = move_table[table_index++];
-			hid_report_in[2] = move_table[table_index++];
-		}
-		else
-		{
-			hid_report_in[1] = 0x00;
-			hid_report_in[2] = 0x00;
-		}
+		hid_report_in[1] = report_x;
+		hid_report_in[2] = report_y;
+		report_ready = 0;
 
 		/* transmit HID report */
 		usb_send_in_buffer(1, 3);
 	}
 }
 
+/* the whole counts in a fixed point movement, rounded towards zero and limited to what a report can carry */
+static int8_t WholeCounts(int16_t movement)
+{
+	int16_t counts;
+
+	counts = (movement < 0) ? -(-movement >> 8) : (movement >> 8);
+	if (counts > 127)
+		counts = 127;
+	else if (counts < -127)
+		counts = -127;
+	return (int8_t)counts;
+}
+
+static void MotionFrame(void)
+{
+	int16_t x, y;
+
+	/*
+	the path is held up while a report waits on the host; besides not running ahead of what the host has seen,
+	this keeps pos_x and pos_y within int16_t range: less than one count left over, plus at most one frame of movement
+	*/
+	if (report_ready)
+		return;
+
+	if (0 == frames_left)
+	{
+		/* start the next move, going back to the start of move_table[] after the last */
+		if (move_index >= sizeof(move_table))
+			move_index = 0;
+
+		x = (int16_t)move_table[move_index] * 256;
+		y = (int16_t)move_table[move_index + 1] * 256;
+		frames_left = (uint8_t)move_table[move_index + 2];
+		move_index += 3;
+
+		/* a division per move, not per frame */
+		step_x = x / frames_left;
+		step_y = y / frames_left;
+		last_x = x - step_x * (frames_left - 1);
+		last_y = y - step_y * (frames_left - 1);
+	}
+
+	if (1 == frames_left)
+	{
+		pos_x += last_x;
+		pos_y += last_y;
+	}
+	else
+	{
+		pos_x += step_x;
+		pos_y += step_y;
+	}
+	frames_left--;
+
+	x = WholeCounts(pos_x);
+	y = WholeCounts(pos_y);
+	if (x || y)
+	{
+		pos_x -= x * 256;
+		pos_y -= y * 256;
+		report_x = (int8_t)x;
+		report_y = (int8_t)y;
+		report_ready = 1;
+	}
+}
+
 /* Callbacks. These function names are set in usb_config.h. */
 void app_set_configuration_callback(uint8_t configuration)
 {
@@ -164,7 +240,7 @@ int16_t app_unknown_get_descriptor_callback(const struct setup_packet *pkt, cons
 
 void app_start_of_frame_callback(void)
 {
-	tick_count++;
+	MotionFrame();
 }
 
 void app_usb_reset_callback(void)
@@ -0,0 +1,209 @@
+/*
+    host-side check of mouseplay's motion engine
+
+    main.c is built for the PC (with -DMOVESIM; see movesim.h) and included
+    here, so that its motion state can be looked at, and its main loop runs
+    against stubs of the USB calls it makes:
+    - usb_service() is one 1 ms USB frame: the host takes the queued IN report,
+      if it polls EP1 in that frame, and then app_start_of_frame_callback()
+      runs, as M-Stack calls it on SOF
+    - the host polls every frame (bInterval is 1 ms), or only every few frames,
+      as on a busy bus, so that the path also has to wait on reports the host
+      hasn't taken yet
+
+    at the end of every move, the counts reported so far (plus any still on
+    their way to the host) must add up to the moves of move_table[] made
+    so far, with nothing left over in the fixed point accumulators; and no
+    report may be empty; it checks whatever move_table[] main.c has, so a
+    table of uneven moves (e.g. 7, -3, 60) or one-frame moves (1, 127, 1)
+    is checked by putting it there and rebuilding
+
+    gcc -O2 -Wall -D__XC8 -DMOVESIM -I. -Iinclude -o movesim movesim.c
+    ./movesim
+
+    Copyright (C) 2014,2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <setjmp.h>
+
+#include "main.c"
+
+/* only main.c's main() is renamed */
+#undef main
+
+#define LOOPS			5
+#define MOVES			(sizeof(move_table) / 3)
+
+volatile movesim_INTCONbits_t INTCONbits;
+
+static struct
+{
+	unsigned host_period;
+	unsigned long frames;
+
+	/* the IN report waiting for the host, the reports sent, and what the host has made of those it took */
+	uint8_t in_buf[EP_1_IN_LEN];
+	bool in_queued;
+	unsigned long reports, empty;
+	long sent_x, sent_y;
+
+	/* the moves of move_table[] completed, and where they should have taken the pointer */
+	unsigned long moves;
+	long table_x, table_y;
+	unsigned long errors;
+} sim;
+
+static jmp_buf finished;
+
+/* at the end of a move: has everything it moved been reported, or is it on its way (with the stack, or still in main.c)? */
+static void check_move(void)
+{
+	long x = sim.sent_x, y = sim.sent_y;
+
+	sim.table_x += move_table[move_index - 3];
+	sim.table_y += move_table[move_index - 2];
+	sim.moves++;
+
+	if (sim.in_queued)
+	{
+		x += (int8_t)sim.in_buf[1];
+		y += (int8_t)sim.in_buf[2];
+	}
+	if (report_ready)
+	{
+		x += report_x;
+		y += report_y;
+	}
+
+	if ( (x != sim.table_x) || (y != sim.table_y) || pos_x || pos_y )
+	{
+		if (sim.errors++ < 5)
+			printf("     move %lu: reported %ld,%ld (%d,%d left over), move_table[] has %ld,%ld\n",
+				sim.moves, x, y, pos_x, pos_y, sim.table_x, sim.table_y);
+	}
+}
+
+/* the M-Stack calls main.c makes */
+
+void usb_init(void)
+{
+}
+
+void usb_service(void)
+{
+	bool paused;
+
+	sim.frames++;
+
+	if (sim.in_queued && (0 == sim.frames % sim.host_period))
+	{
+		sim.sent_x += (int8_t)sim.in_buf[1];
+		sim.sent_y += (int8_t)sim.in_buf[2];
+		sim.in_queued = false;
+	}
+
+	/* MotionFrame() does nothing while a report is waiting */
+	paused = report_ready;
+	app_start_of_frame_callback();
+	if (!paused && (0 == frames_left))
+		check_move();
+
+	if (sim.moves == LOOPS * MOVES)
+		longjmp(finished, 1);
+}
+
+uint8_t usb_get_configuration(void)
+{
+	return 1;
+}
+
+unsigned char *usb_get_in_buffer(uint8_t endpoint)
+{
+	(void)endpoint;
+	return sim.in_buf;
+}
+
+void usb_send_in_buffer(uint8_t endpoint, size_t len)
+{
+	(void)endpoint;
+	(void)len;
+	if (!sim.in_buf[1] && !sim.in_buf[2])
+		sim.empty++;
+	sim.reports++;
+	sim.in_queued = true;
+}
+
+bool usb_in_endpoint_busy(uint8_t endpoint)
+{
+	(void)endpoint;
+	return sim.in_queued;
+}
+
+bool usb_in_endpoint_halted(uint8_t endpoint)
+{
+	(void)endpoint;
+	return false;
+}
+
+uint8_t process_hid_setup_request(const struct setup_packet *setup)
+{
+	(void)setup;
+	return -1;
+}
+
+static int run(unsigned host_period)
+{
+	unsigned long frames_per_loop = 0;
+	unsigned i;
+	bool ok;
+
+	memset(&sim, 0, sizeof(sim));
+	sim.host_period = host_period;
+	move_index = frames_left = 0;
+	pos_x = pos_y = 0;
+	report_ready = 0;
+
+	for (i = 0; i < sizeof(move_table); i += 3)
+		frames_per_loop += (uint8_t)move_table[i + 2];
+
+	if (0 == setjmp(finished))
+		mouseplay_main();
+
+	ok = !sim.errors && !sim.empty;
+
+	printf("%s host polls every %u frame(s): %d loops of %u moves in %lu frames (%lu without waiting on the host), %lu reports, %lu empty, %lu moves wrong\n",
+		ok ? "ok  " : "FAIL", host_period, LOOPS, (unsigned)MOVES, sim.frames, LOOPS * frames_per_loop, sim.reports, sim.empty, sim.errors);
+
+	return ok ? 0 : 1;
+}
+
+int main(void)
+{
+	static const unsigned host_periods[] = { 1, 4, 16, 64 };
+	unsigned i;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(host_periods) / sizeof(host_periods[0]); i++)
+		failures += run(host_periods[i]);
+
+	return failures ? 1 : 0;
+}
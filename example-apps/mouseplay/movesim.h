@@ -0,0 +1,17 @@
+/*
+    host build of mouseplay's main.c, for movesim.c
+
+    stands in for <xc.h> when main.c is built with -DMOVESIM; movesim.c has
+    the real main(), and runs main.c's main loop through stubs of the USB calls
+*/
+
+#ifndef MOVESIM_H__
+#define MOVESIM_H__
+
+#define interrupt
+#define main mouseplay_main
+
+typedef struct { unsigned PEIE:1; unsigned GIE:1; } movesim_INTCONbits_t;
+extern volatile movesim_INTCONbits_t INTCONbits;
+
+#endif /* MOVESIM_H__ */
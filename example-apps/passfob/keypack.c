@@ -0,0 +1,152 @@
+/*
+    macro playback for passfob, packing key strokes into boot keyboard reports
+
+    this file has no USB dependencies, so that keysim.c can run the
+    very same playback on a PC
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "keypack.h"
+
+#if (KEYS_PER_REPORT < 1) || (KEYS_PER_REPORT > 6)
+#error "KEYS_PER_REPORT must be between 1 and 6"
+#endif
+
+static const uint8_t *macro;
+static uint16_t pc;
+static bool active;
+
+/* modifiers for the keys being typed */
+static uint8_t modifier;
+
+/* frames left of a DELAY */
+static uint8_t delay_left;
+
+/* REPEAT in progress: its body runs from repeat_start up to repeat_end, repeat_left more times */
+static uint16_t repeat_start;
+static uint16_t repeat_end;
+static uint8_t repeat_left;
+
+/* modifiers and keys down in the last report sent */
+static uint8_t held_modifier;
+static uint8_t held[6];
+
+/* true if key is one of the first n entries of list */
+static bool key_in(uint8_t key, const uint8_t *list, uint8_t n)
+{
+	while (n--)
+		if (key == *list++)
+			return true;
+	return false;
+}
+
+void keypack_start(const uint8_t *code)
+{
+	macro = code;
+	pc = 0;
+	active = true;
+	modifier = 0;
+	delay_left = 0;
+	repeat_left = 0;
+	held_modifier = 0;
+	memset(held, 0, sizeof(held));
+}
+
+bool keypack_busy(void)
+{
+	return active;
+}
+
+bool keypack_next(uint8_t *report)
+{
+	uint8_t *slots = &report[2];
+	uint8_t n = 0;
+	uint8_t op;
+
+	if (!active)
+		return false;
+
+	if (delay_left)
+	{
+		delay_left--;
+		return false;
+	}
+
+	while (n < KEYS_PER_REPORT)
+	{
+		if ( (pc == repeat_end) && repeat_left )
+		{
+			repeat_left--;
+			pc = repeat_start;
+		}
+
+		op = macro[pc];
+
+		if (MACRO_END == op)
+		{
+			break;
+		}
+		else if (MACRO_MOD == op)
+		{
+			/* one report has one set of modifiers, so a change starts a new report */
+			if ( n && (macro[pc + 1] != modifier) )
+				break;
+			modifier = macro[pc + 1];
+			pc += 2;
+		}
+		else if (MACRO_DELAY == op)
+		{
+			/* send what there is, then release everything, before starting the delay */
+			if (n || held_modifier || held[0])
+				break;
+			delay_left = macro[pc + 1];
+			pc += 2;
+			if (delay_left)
+			{
+				/* this frame is the first of the delay */
+				delay_left--;
+				return false;
+			}
+		}
+		else if (MACRO_REPEAT == op)
+		{
+			repeat_left = macro[pc + 1];
+			repeat_start = pc + 3;
+			repeat_end = repeat_start + macro[pc + 2];
+			pc = repeat_start;
+			if (repeat_left)
+				repeat_left--;
+			else
+				pc = repeat_end; /* played zero times */
+		}
+		else
+		{
+			/* a key that is already down has to be released before the host will see it again */
+			if (key_in(op, held, sizeof(held)) || key_in(op, slots, n))
+				break;
+			slots[n++] = op;
+			pc++;
+		}
+	}
+
+	if (0 == n)
+	{
+		/* the macro has ended, with nothing left down */
+		if ( (MACRO_END == macro[pc]) && !held_modifier && !held[0] )
+		{
+			active = false;
+			return false;
+		}
+	}
+
+	/* an all-release report either makes way for a repeated key or a delay, or ends the playback */
+	report[0] = n ? modifier : 0;
+	report[1] = 0;
+	memset(&slots[n], 0, sizeof(held) - n);
+	held_modifier = report[0];
+	memcpy(held, slots, sizeof(held));
+
+	return true;
+}
@@ -0,0 +1,43 @@
+/*
+    macro playback for passfob, packing key strokes into boot keyboard reports
+*/
+
+#ifndef KEYPACK_H__
+#define KEYPACK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+how many of the boot keyboard report's six key slots are filled per report
+1 gives the classic one key per report; 6 types up to six keys per USB frame
+*/
+#ifndef KEYS_PER_REPORT
+#define KEYS_PER_REPORT 6
+#endif
+
+/*
+macro bytecode, as produced from text by mkmacro.c
+any byte other than the opcodes below is the "Usage ID" of a key to type (Keyboard/Keypad Page 0x07, which stops at 0xE7)
+*/
+#define MACRO_END    0x00 /* end of the macro */
+#define MACRO_MOD    0xF0 /* MOD m: type the keys that follow with modifier bits m (byte 0 of the report) held */
+#define MACRO_DELAY  0xF1 /* DELAY n: release all keys and send nothing for n frames (i.e. milliseconds) */
+#define MACRO_REPEAT 0xF2 /* REPEAT count len: play the len bytes that follow count times; does not nest */
+
+/* begin playing back the macro at code[] (which must stay valid until done) */
+void keypack_start(const uint8_t *code);
+
+/*
+build the next report in report[] (all eight bytes of the boot keyboard report); call once per USB frame
+each report presses as many of the next keys as fit, stopping early at a key that is already down (in this report
+or the previous one), since the host only sees a key stroke when a key goes from up to down, or at a change of
+modifiers; a report with no keys at all releases everything, so the repeated key can follow in the report after
+returns true if there is a report to send, or false if there is nothing to send this frame (during a DELAY, or once done)
+*/
+bool keypack_next(uint8_t *report);
+
+/* true until the macro has been played out, ending with every key released */
+bool keypack_busy(void);
+
+#endif /* KEYPACK_H__ */
@@ -0,0 +1,117 @@
+/*
+    simulated host for passfob's macro playback
+
+    Compiles a set of texts (and any given on the command line) with
+    mkmacro.c, plays each back with keypack.c, exactly as built into the
+    firmware, one report per USB frame as main.c sends them, decodes the
+    boot keyboard reports as a host does, and checks that the text typed
+    matches.  Also shows the bytecode size and the frames taken, against
+    the two reports per key of typing each key and then releasing it.
+
+    gcc -O2 -Wall -DKEYSIM -o keysim keysim.c keypack.c mkmacro.c
+    ./keysim ["more text" ...]
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "keypack.h"
+#include "mkmacro.h"
+
+#define MAX_CODE 8192
+#define MAX_TEXT 8192
+
+/*
+A host sees a key stroke for every usage in a report's key array that
+wasn't in the previous report, taking them in array order, with the
+modifiers of that report, as Linux's hid-input does.
+*/
+static int run(const char *text)
+{
+	static uint8_t code[MAX_CODE];
+	static char expected[MAX_TEXT], typed[MAX_TEXT];
+	uint8_t report[8], prev[8];
+	int len, frames = 0, keys = 0, n = 0, i;
+	bool ok;
+
+	if (strlen(text) >= MAX_TEXT) {
+		printf("FAIL text too long\n");
+		return 1;
+	}
+	len = mkmacro(text, code, sizeof(code), expected);
+	if (len < 0) {
+		printf("FAIL can't compile \"%s\"\n", text);
+		return 1;
+	}
+
+	memset(prev, 0, sizeof(prev));
+	keypack_start(code);
+	while (keypack_busy()) {
+		frames++;
+		if (!keypack_next(report))
+			continue;
+		for (i = 2; i < 8; i++) {
+			if (report[i] && !memchr(&prev[2], report[i], 6)) {
+				keys++;
+				/* as mkmacro() leaves keys such as F1 out of expected */
+				if (n < MAX_TEXT - 1 && macro_char(report[i], report[0]))
+					typed[n++] = macro_char(report[i], report[0]);
+			}
+		}
+		memcpy(prev, report, sizeof(prev));
+	}
+	typed[n] = 0;
+
+	/* the last report must leave every key up */
+	ok = !strcmp(typed, expected);
+	for (i = 0; i < 8; i++)
+		if (prev[i])
+			ok = false;
+
+	printf("%s %4d keys, %4d bytes, %5d frames (%d one key at a time): \"%s\"\n",
+		ok ? "ok  " : "FAIL", keys, len, frames, 2 * keys, text);
+	if (!ok)
+		printf("     typed \"%s\"\n", typed);
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *tests[] = {
+		"",
+		"a",
+		"abcd",
+		"aa",
+		"aaaa",
+		"abab",
+		"abcdefabcdef",
+		"abcdefga",
+		"abcdefgb",
+		"mississippi",
+		"aA",
+		"AbAbAbAb",
+		"Hello, World!!!",
+		"correct horse battery staple",
+		"The Quick Brown Fox Jumps Over The Lazy Dog 0123456789",
+		"p4ssw0rd-with;punctuation,and/slashes.=[]\\\\'`~!@#$%^&*()_+\\{}|:\"<>?",
+		"user\\tpassword\\n",
+		"wait{delay 20}for it{delay 300}!",
+		"{0x3a}F1",
+		"zyxwvutsrqponmlkjihgfedcbazyxwvutsrqponmlkjihgfedcba",
+		"================================================================",
+		"-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=",
+	};
+	int failed = 0;
+	unsigned int i;
+
+	printf("KEYS_PER_REPORT %d\n", KEYS_PER_REPORT);
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+		failed += run(tests[i]);
+	for (i = 1; i < (unsigned int)argc; i++)
+		failed += run(argv[i]);
+
+	if (failed)
+		printf("%d failed\n", failed);
+	return failed ? 1 : 0;
+}
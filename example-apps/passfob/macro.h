@@ -0,0 +1,10 @@
+/*
+macro for passfob to type, generated by mkmacro from:
+abcd
+(5 bytes)
+*/
+
+const uint8_t macro_code[] =
+{
+	0x04, 0x05, 0x06, 0x07, 0x00,
+};
@@ -31,6 +31,7 @@
 #include "usb_config.h"
 #include "usb_ch9.h"
 #include "usb_hid.h"
+#include "keypack.h"
 
 /* 
 since this is a downloaded app, configuration words (e.g. __CONFIG or #pragma config) are not relevant
@@ -50,25 +51,21 @@ this determines which bit to monitor for the bootloader entry
 /* flag set upon USB SOF (Start Of Frame) to track approximate time */
 static uint8_t ms_tick = 0;
 
+/* flag set upon USB SOF so that key strokes go out at one report per frame, the rate at which the host polls EP1 IN */
+static uint8_t report_tick = 0;
+
 /*
-arbitrary key strokes to play back
-you MUST consult Section 10 "Keyboard/Keypad Page (0x07)" of the USB "HID Usage Tables" specification
-in order to look up the "Usage ID" of each key press
+key strokes to play back, as macro bytecode in program memory (see keypack.h)
+macro.h is generated from text by the mkmacro host tool; for other keys, consult Section 10 "Keyboard/Keypad Page (0x07)"
+of the USB "HID Usage Tables" specification to look up their "Usage ID" and write them as {0xNN}
 */
-const uint8_t key_table[] =
-{
-	0x4, // 'a'
-	0x5, // 'b'
-	0x6, // 'c'
-	0x7, // 'd'
-};
+#include "macro.h"
 
 static uint16_t keylock_tick_count = 0;
 static uint8_t last_keylock_state = 0;
 
 int main(void)
 {
-	uint8_t table_index = 0;
 	uint16_t count = MIN_TRIGGER_MS;
 	enum
 	{
@@ -114,7 +111,7 @@ int main(void)
 					else if (ARMED == state)
 					{
 						state = TRANSMITTING;
-						table_index = 0;
+						keypack_start(macro_code);
 					}
 				}
 			}
@@ -126,29 +123,21 @@ int main(void)
 		if (usb_in_endpoint_halted(1) || usb_in_endpoint_busy(1))
 			continue;
 
-		/* build HID report */
-		if (TRANSMITTING == state)
+		/* build HID report, packing up to KEYS_PER_REPORT key strokes into it (see keypack.h) */
+		if ( (TRANSMITTING == state) && report_tick )
 		{
-			hid_report_in[0] = 0;
-			hid_report_in[1] = 0;
-			if (sizeof(key_table) == table_index)
+			report_tick = 0;
+
+			if (keypack_next(hid_report_in))
 			{
-				state = COOLDOWN;
-				hid_report_in[2] = 0x00;
+				/* transmit HID report */
+				usb_send_in_buffer(1, EP_1_IN_LEN);
 			}
-			else
+			else if (!keypack_busy())
 			{
-				hid_report_in[2] = key_table[table_index];
-				table_index++;
+				/* the final release has gone out */
+				state = COOLDOWN;
 			}
-			hid_report_in[3] = 0;
-			hid_report_in[4] = 0;
-			hid_report_in[5] = 0;
-			hid_report_in[6] = 0;
-			hid_report_in[7] = 0;
-
-			/* transmit HID report */
-			usb_send_in_buffer(1, EP_1_IN_LEN);
 		}
 	}
 }
@@ -210,6 +199,7 @@ int16_t app_unknown_get_descriptor_callback(const struct setup_packet *pkt, cons
 void app_start_of_frame_callback(void)
 {
        	ms_tick = 1;
+	report_tick = 1;
 
 	/* if chosen KEYLOCK is now on, increment keylock_tick_count until it reaches 65535 */
 	if (last_keylock_state & BOOTLOADER_ENTRY_KEYLOCK_MASK)
@@ -0,0 +1,235 @@
+/*
+    macro compiler for passfob
+
+    Turns text into the macro bytecode played back by keypack.c (see
+    keypack.h), as a C table for main.c:
+
+    gcc -O2 -Wall -o mkmacro mkmacro.c
+    ./mkmacro "text to type" > macro.h
+
+    Characters are typed as on a US keyboard, with shift held as needed.
+    \n is Enter, \t is Tab, \\ and \{ are themselves, {delay N} pauses
+    for N ms and {0xNN} types the key with that Usage ID (e.g. {0x3a}
+    for F1).
+
+    The bytecode is kept compact: MOD is only emitted when the modifiers
+    change, and runs of a repeated sequence (of up to MAX_UNIT keys and
+    other operations) become one REPEAT.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "keypack.h"
+#include "mkmacro.h"
+
+#define MAX_CODE 8192 /* well within what the 14 KB app space holds as a table */
+#define MAX_UNIT 32   /* longest sequence of operations looked for as a REPEAT body */
+
+#define MOD_LEFT_SHIFT 0x02
+
+/* what each usage from 0x04 types on a US keyboard, without and with shift; \001 for nothing */
+static const char unshifted[] = "abcdefghijklmnopqrstuvwxyz1234567890\n\001\001\t -=[]\\\001;'`,./";
+static const char shifted[]   = "ABCDEFGHIJKLMNOPQRSTUVWXYZ!@#$%^&*()\001\001\001\001\001_+{}|\001:\"~<>?";
+
+char macro_char(uint8_t usage, uint8_t modifier)
+{
+	const char *table = (modifier & (MOD_LEFT_SHIFT | 0x20)) ? shifted : unshifted;
+
+	if (usage < 0x04 || usage >= 0x04 + sizeof(unshifted) - 1 || table[usage - 0x04] == '\001')
+		return 0;
+	return table[usage - 0x04];
+}
+
+/* one operation: a key, MOD or DELAY, of one or two bytes */
+struct op {
+	uint8_t len;
+	uint8_t b[2];
+};
+
+static int same_ops(const struct op *a, const struct op *b, int n)
+{
+	for (; n; n--, a++, b++)
+		if (a->len != b->len || memcmp(a->b, b->b, a->len))
+			return 0;
+	return 1;
+}
+
+int mkmacro(const char *text, uint8_t *code, int size, char *typed)
+{
+	static struct op ops[MAX_CODE];
+	int nops = 0, len = 0, i, j, L, r, bytes;
+	uint8_t modifier = 0, want, usage;
+	const char *p, *q;
+	unsigned long n;
+	char c;
+
+	for (p = text; *p; p++) {
+		if (nops + 2 > MAX_CODE) {
+			fprintf(stderr, "mkmacro: text too long\n");
+			return -1;
+		}
+
+		if (*p == '{') {
+			n = strtoul(p + 1 + (strncmp(p + 1, "delay ", 6) ? 0 : 6), (char **)&q, 0);
+			if (*q != '}' || q == p + 1) {
+				fprintf(stderr, "mkmacro: bad {...} at \"%.10s\"\n", p);
+				return -1;
+			}
+			if (!strncmp(p + 1, "delay ", 6)) {
+				/* in steps of at most 255 ms */
+				for (; n; n -= (n > 255) ? 255 : n) {
+					if (nops + 1 > MAX_CODE) {
+						fprintf(stderr, "mkmacro: text too long\n");
+						return -1;
+					}
+					ops[nops].len = 2;
+					ops[nops].b[0] = MACRO_DELAY;
+					ops[nops].b[1] = (n > 255) ? 255 : (uint8_t)n;
+					nops++;
+				}
+			}
+			else {
+				if (n < 0x04 || n > 0xE7) {
+					fprintf(stderr, "mkmacro: {0x%lx} isn't a key\n", n);
+					return -1;
+				}
+				ops[nops].len = 1;
+				ops[nops].b[0] = (uint8_t)n;
+				nops++;
+				if (typed && macro_char((uint8_t)n, modifier))
+					*typed++ = macro_char((uint8_t)n, modifier);
+			}
+			p = q;
+			continue;
+		}
+
+		c = *p;
+		if (c == '\\' && p[1]) {
+			c = *++p;
+			if (c == 'n')
+				c = '\n';
+			else if (c == 't')
+				c = '\t';
+		}
+
+		usage = 0;
+		want = 0;
+		for (i = 0; unshifted[i]; i++) {
+			if (unshifted[i] == c) {
+				usage = i + 0x04;
+				break;
+			}
+			if (shifted[i] == c) {
+				usage = i + 0x04;
+				want = MOD_LEFT_SHIFT;
+				break;
+			}
+		}
+		if (!usage || c == '\001') {
+			fprintf(stderr, "mkmacro: can't type character 0x%02x\n", (unsigned char)c);
+			return -1;
+		}
+
+		if (want != modifier) {
+			ops[nops].len = 2;
+			ops[nops].b[0] = MACRO_MOD;
+			ops[nops].b[1] = want;
+			nops++;
+			modifier = want;
+		}
+		ops[nops].len = 1;
+		ops[nops].b[0] = usage;
+		nops++;
+		if (typed)
+			*typed++ = c;
+	}
+	if (typed)
+		*typed = 0;
+
+	/* emit, folding runs of a repeated sequence into REPEAT where that saves space */
+	for (i = 0; i < nops; ) {
+		int best_L = 0, best_r = 0, best_saving = 0;
+
+		for (L = 1; L <= MAX_UNIT && i + 2 * L <= nops; L++) {
+			for (bytes = 0, j = 0; j < L; j++)
+				bytes += ops[i + j].len;
+			if (bytes > 255)
+				break;
+			for (r = 1; r < 255 && i + (r + 1) * L <= nops && same_ops(&ops[i], &ops[i + r * L], L); r++)
+				;
+			if ((r - 1) * bytes - 3 > best_saving) {
+				best_saving = (r - 1) * bytes - 3;
+				best_L = L;
+				best_r = r;
+			}
+		}
+
+		if (best_L) {
+			if (len + 3 > size) {
+				fprintf(stderr, "mkmacro: bytecode too long\n");
+				return -1;
+			}
+			for (bytes = 0, j = 0; j < best_L; j++)
+				bytes += ops[i + j].len;
+			code[len++] = MACRO_REPEAT;
+			code[len++] = (uint8_t)best_r;
+			code[len++] = (uint8_t)bytes;
+		}
+		else {
+			best_L = 1;
+			best_r = 1;
+		}
+
+		for (j = 0; j < best_L; j++) {
+			if (len + ops[i + j].len > size) {
+				fprintf(stderr, "mkmacro: bytecode too long\n");
+				return -1;
+			}
+			memcpy(&code[len], ops[i + j].b, ops[i + j].len);
+			len += ops[i + j].len;
+		}
+		i += best_L * best_r;
+	}
+
+	if (len + 1 > size) {
+		fprintf(stderr, "mkmacro: bytecode too long\n");
+		return -1;
+	}
+	code[len++] = MACRO_END;
+	return len;
+}
+
+#ifndef KEYSIM
+int main(int argc, char *argv[])
+{
+	static uint8_t code[MAX_CODE];
+	int len, i;
+	const char *p;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s \"text to type\" > macro.h\n", argv[0]);
+		return 1;
+	}
+
+	len = mkmacro(argv[1], code, sizeof(code), NULL);
+	if (len < 0)
+		return 1;
+
+	printf("/*\nmacro for passfob to type, generated by mkmacro from:\n");
+	for (p = argv[1]; *p; p++) {
+		/* keep the comment intact */
+		if (p[0] == '*' && p[1] == '/')
+			printf("* ");
+		else if (*p != '\n')
+			putchar(*p);
+	}
+	printf("\n(%d bytes)\n*/\n\n", len);
+	printf("const uint8_t macro_code[] =\n{");
+	for (i = 0; i < len; i++)
+		printf("%s0x%02x,", (i % 12) ? " " : "\n\t", code[i]);
+	printf("\n};\n");
+	return 0;
+}
+#endif
@@ -0,0 +1,20 @@
+/*
+    host-side macro compiler for passfob (see mkmacro.c)
+*/
+
+#ifndef MKMACRO_H__
+#define MKMACRO_H__
+
+#include <stdint.h>
+
+/*
+compile text into macro bytecode (keypack.h) in code[], of size bytes
+typed, if not NULL, gets the characters a host should see typed (with room for strlen(text) + 1)
+returns the length of the bytecode, including MACRO_END, or -1 (with a message on stderr)
+*/
+int mkmacro(const char *text, uint8_t *code, int size, char *typed);
+
+/* the character a US keyboard types for usage with modifier bits, or 0 if none */
+char macro_char(uint8_t usage, uint8_t modifier);
+
+#endif /* MKMACRO_H__ */
@@ -17,6 +17,18 @@
 ;  dfu-util -D write.bin -t 64
 ; the download file must incorporate a valid CRC-14 for the bootloader to consider it valid
 ;
+; a HEF image (four rows, from 454hex2dfu --hef) only writes high-endurance flash
+;  dfu-util -D hef.dfu
+; as dfu-util numbers its blocks from 0, 454hex2dfu sets bit 15 (never set in a
+; 14-bit instruction word) of the first word of each row; a row carrying that flag
+; is written to high-endurance flash (rows 252-255) whatever its block number
+; otherwise blocks 0-15 are the rows _WRT_BOOT protects (0x000-0x1FF), which are
+; never written, so a full image sent from block 0 writes high-endurance flash last
+;
+; rows may be uploaded and downloaded in any order (see wBlockNum below), which
+; tools/454dfu relies upon to resume an interrupted download: it reads back every
+; row, writes only those that differ, and writes the row holding the CRC last
+;
 ; Bootloader is entered if:
 ; - the MCLR/RA3 pin is grounded at power-up or reset,
 ; (The internal pull-up is used; no external resistor is necessary.)
@@ -25,6 +37,25 @@
 ;
 ; A pre-computed CRC-14 at 0x1F7F confirms a valid application.
 ;
+; Building with gpasm -D DUAL_SLOT=1 splits the application area in two slots,
+; each with its own CRC-14 in its last word:
+;   slot A: 0x0200-0x11FF (XC8 --codeoffset=0x200  --rom=default,-0-1FF,-11FF-1FFF)
+;   slot B: 0x1200-0x1F7F (XC8 --codeoffset=0x1200 --rom=default,-0-11FF,-1F7F-1FFF)
+; Bit 0 of the last high-endurance flash word (0x1FFF) selects the slot to start:
+; 0 for slot A, 1 (erased) for slot B.  If that slot fails its CRC-14, the other
+; one is started instead, so an update written to the unused slot only takes
+; over once the selector is changed after it has been completely written.
+; (tools/454hex2dfu -s a|b builds a slot image; tools/454dfu -s a|b downloads it,
+; and changes the selector last)
+; This build has no room for the serial number string descriptor.
+;
+; Building with gpasm -D SUSPEND_SLEEP=1 puts the device to SLEEP whenever the
+; host suspends the bus (no SOFs for 3 ms), waking on bus activity, instead of
+; polling at 48MHz.  The device cannot SLEEP while the bus is active, as the
+; SIE needs the clock to answer the host.  On waking, it waits for the PLL to
+; lock again before serving the bus.  This build also has no room for the
+; serial number string descriptor, nor for DUAL_SLOT as well.
+;
 ; At application start, the device is configured with a 48MHz CPU clock,
 ; using the internal oscillator and 3x PLL. If a different oscillator
 ; configuration is required, it must be set by the application.
@@ -75,6 +106,20 @@ HIDE_SERIAL_NUMBER	equ	1
 	ifndef SERIAL_NUMBER
 	variable SERIAL_NUMBER=0	; Why doesnt 'equ' work here? Go figure
 	endif
+	ifndef DUAL_SLOT
+	variable DUAL_SLOT=0
+	endif
+	ifndef SUSPEND_SLEEP
+	variable SUSPEND_SLEEP=0
+	endif
+	if DUAL_SLOT && SUSPEND_SLEEP
+	error "DUAL_SLOT and SUSPEND_SLEEP do not both fit"
+	endif
+; either option takes the place of the serial number string descriptor
+OMIT_SERIAL_STRING	equ	DUAL_SLOT || SUSPEND_SLEEP
+	if OMIT_SERIAL_STRING && !HIDE_SERIAL_NUMBER
+	error "DUAL_SLOT and SUSPEND_SLEEP need HIDE_SERIAL_NUMBER"
+	endif
 
 ; If your organization has its own vendor ID/product ID, substitute it here.
 ; the VID:PID for the DFU bootloader must be distinct from the product itself, as Windows insists on it
@@ -86,7 +131,11 @@ DEVICE_DESC_LEN		equ	18	; device descriptor length
 CONFIG_DESC_TOTAL_LEN	equ	27	; total length of configuration descriptor and sub-descriptors
 EXTRAS_LEN		equ	11	; total length of extras
 SERIAL_NUM_DESC_LEN	equ	2+(SERIAL_NUMBER_DIGIT_CNT*2)
+	if OMIT_SERIAL_STRING
+ALL_DESCS_TOTAL_LEN	equ	DEVICE_DESC_LEN+CONFIG_DESC_TOTAL_LEN+EXTRAS_LEN
+	else
 ALL_DESCS_TOTAL_LEN	equ	DEVICE_DESC_LEN+CONFIG_DESC_TOTAL_LEN+EXTRAS_LEN+SERIAL_NUM_DESC_LEN
+	endif
 
 EP0_BUF_SIZE 		equ	64	; endpoint 0 buffer size
 
@@ -119,6 +168,14 @@ BOOTLOADER_SIZE		equ	0x200
 ; Application code locations
 APP_ENTRY_POINT		equ	0x200
 APP_INTERRUPT		equ	(APP_ENTRY_POINT+4)
+; with DUAL_SLOT, slot B is 2K-word pages above slot A, so only PCLATH differs in a goto to either
+APP_B_ENTRY_POINT	equ	0x1200
+APP_B_INTERRUPT		equ	(APP_B_ENTRY_POINT+4)
+HIGH_ENDURANCE_ADDRESS	equ	0x1F80
+SLOT_SELECT_ADDRESS	equ	HIGH_ENDURANCE_ADDRESS+127	; last word of high-endurance flash
+	if (APP_B_ENTRY_POINT & 0x7FF) != (APP_ENTRY_POINT & 0x7FF)
+	error "slot B must be a whole number of 2K-word pages above slot A"
+	endif
 
 ; USB_STATE bit flags
 IS_CONTROL_WRITE	equ	0	; current endpoint 0 transaction is a control write
@@ -134,6 +191,7 @@ COUNTDOWN		equ	0x71
 CRCL			equ	0x72
 CRCH			equ	0x73
 ROW_COUNT		equ	0x74
+ACTIVE_SLOT		equ	0x75	; DUAL_SLOT only: bit 0 is the slot being checked or started
 
 ;;; Vectors
 	org	0x0000
@@ -147,6 +205,15 @@ RESET_VECT
 	org	0x0004
 INTERRUPT_VECT
 	movlp	high APP_INTERRUPT	; XC8 *expects* this
+	if DUAL_SLOT
+; the interrupted PC (top of stack) tells which slot is running
+; W, STATUS and BSR are restored from the shadow registers by RETFIE
+	movlb	31
+	movlw	high APP_B_ENTRY_POINT
+	subwf	TOSH,w
+	btfsc	STATUS,C
+	movlp	high APP_B_INTERRUPT
+	endif
 	goto	APP_INTERRUPT
 
 ; perform flash unlock sequence
@@ -191,6 +258,13 @@ out_finish
 ; row of flash data to write is in BANKED_EP0OUT_BUF; PMADRL:PMADRH are already written
 	ldfsr0d	EP_DATA_BUF_END		; set up source pointer
 	banksel	PMADRL
+; a row flagged by 454hex2dfu --hef (bit 15 of its first word) goes to high-endurance flash
+	moviw	1[FSR0]
+	andlw	0x80
+	iorwf	PMADRL,f		; PMADRL = 0x80 | (row & 3) << 5
+	btfsc	WREG,7
+	movlw	high HIGH_ENDURANCE_ADDRESS
+	iorwf	PMADRH,f		; PMADRH = 0x1F; PMDATH drops the flag bit itself
 ; erase row
 	bsf	PMCON1,FREE
 	bsf	PMCON1,WREN
@@ -204,9 +278,8 @@ _flash_write_loop
 	movwf	PMDATL
 	moviw	FSR0++
 	movwf	PMDATH
-	movfw	PMADRL
-	andlw	b'00011111'	; mask address to yield row element number
-	sublw	31
+	comf	PMADRL,w
+	andlw	b'00011111'	; zero for the last row element (31)
 	btfsc	STATUS,Z
 	bcf	PMCON1,LWLO	; we've now written to all the latches; this unlock is going to be special
 	call	flash_unlock_sequence
@@ -439,8 +512,7 @@ _usb_get_configuration
 	incw
 	movwf	EP0_DATA_IN_PTR
 	movlw	1
-	movwf	EP0_DATA_IN_COUNT
-	goto	_usb_ctrl_complete
+	goto	_set_data_in_count_from_w
 
 ; Handles an IN control transfer on endpoint 0.
 ; BSR=0
@@ -517,25 +589,21 @@ set_pm_address
 
 ; copy flash contents (PMDATH/PMDATL) to EP0IN_BUF (FSR1)
 ep0_read_dfu_in
-; BANKED_EP0IN_CNT was already cleared in ep0_read_in
+; a whole row (EP0_BUF_SIZE bytes) is always sent
+	movlw	EP0_BUF_SIZE
+	movwf	BANKED_EP0IN_CNT
 	ldfsr1d	EP0IN_BUF		; set up destination pointer
 	call	set_pm_address
-read_flash
-	clrw
 _pmcopy
-	sublw	EP0_BUF_SIZE		; have we filled the buffer?
-	bz	_pmbail
 	call	_core_flash_read
 	movwi	FSR1++
 	movfw	PMDATH
 	movwi	FSR1++
 	incf	PMADRL,f		; increment LSB of Program Memory address
+	movfw	PMADRL
+	andlw	b'00011111'		; stop at the end of the row
+	bnz	_pmcopy
 	banksel	BANKED_EP0OUT_STAT
-	incf	BANKED_EP0IN_CNT,f	; increase number of bytes copied by two
-	incf	BANKED_EP0IN_CNT,f
-	movfw	BANKED_EP0IN_CNT	; save to test on the next iteration
-	goto	_pmcopy
-_pmbail
 ret	return
 
 _core_flash_read
@@ -546,6 +614,32 @@ _core_flash_read
 	movfw	PMDATL
 	return
 
+	if DUAL_SLOT
+;;; Calculates the CRC-14 of the slot selected by ACTIVE_SLOT
+;;; arguments:	BSR=PMADRL
+;;; returns:	Z set if the slot is valid
+;;; clobbers:	W, PMADRL, PMADRH, CRCL, CRCH, ROW_COUNT, SCRATCHPAD, COUNTDOWN
+slot_crc
+	clrf	PMADRL			; both slots start on a row boundary
+	movlw	high APP_ENTRY_POINT
+	btfsc	ACTIVE_SLOT,0
+	movlw	high APP_B_ENTRY_POINT
+	movwf	PMADRH
+	movlw	(APP_B_ENTRY_POINT-APP_ENTRY_POINT)/32
+	btfsc	ACTIVE_SLOT,0
+	movlw	(HIGH_ENDURANCE_ADDRESS-APP_B_ENTRY_POINT)/32
+	movwf	ROW_COUNT
+	clrf	CRCL			; initialize CRC value
+	clrf	CRCH
+_slot_crc_loop
+	call	_crc_calc
+	decf	ROW_COUNT,f
+	bnz	_slot_crc_loop
+	movfw	CRCL
+	iorwf	CRCH,w
+	return
+	endif
+
 _crc_calc
 	call	_core_flash_read
 	call	_core_crc
@@ -585,22 +679,29 @@ _crc_no_xor
 ;;; BSR=1 (OSCCON bank)
 bootloader_start
 ; Configure the oscillator (48MHz from INTOSC using 3x PLL)
+; rather than waiting here, the CRC below runs on HFINTOSC while the PLL locks;
+; wait_osc is only called where the 48MHz clock is needed: the app and USB
 	movlw	(1<<SPLLEN)|(1<<SPLLMULT)|(1<<IRCF3)|(1<<IRCF2)|(1<<IRCF1)|(1<<IRCF0)
 	movwf	OSCCON
 
-; Wait for the oscillator and PLL to stabilize
-; NOTE: remove in a pinch? the time taken below for the CRC calculation *should* be more than the worse case here
-_wosc	movlw	(1<<PLLRDY)|(1<<HFIOFR)|(1<<HFIOFS)
-	andwf	OSCSTAT,w
-	sublw	(1<<PLLRDY)|(1<<HFIOFR)|(1<<HFIOFS)
-	bnz	_wosc
-
-; Enable active clock tuning
-	movlw	(1<<ACTEN)|(1<<ACTSRC)
-	movwf	ACTCON
-
 ; calc CRC of application (and provide enough delay for the pull-up on RA3/MCLR to work)
 	banksel	PMADRL
+	if DUAL_SLOT
+; try the slot chosen by the selector word first, then the other one
+	movlw	low SLOT_SELECT_ADDRESS
+	movwf	PMADRL
+	movlw	high SLOT_SELECT_ADDRESS
+	movwf	PMADRH
+	call	_core_flash_read
+	movwf	ACTIVE_SLOT
+	call	slot_crc
+	bz	_slot_valid
+	movlw	1
+	xorwf	ACTIVE_SLOT,f
+	call	slot_crc
+	bnz	_bootloader_main
+_slot_valid
+	else
 	movlw	low APP_ENTRY_POINT	; set start address of read to beginning of app
 	movwf	PMADRL
 	movlw	high APP_ENTRY_POINT
@@ -619,6 +720,7 @@ app_check_loop
 	bnz	_bootloader_main
 	tstf	CRCH
 	bnz	_bootloader_main
+	endif
 
 ; do not run application if the watchdog timed out (providing a mechanism for the app to trigger a firmware update)
 	btfss	STATUS,NOT_TO
@@ -630,13 +732,25 @@ app_check_loop
 	goto	_bootloader_main	; enter bootloader mode if input is low
 
 ; We have a valid application and the entry pin is high. Start the application.
+	call	wait_osc
 	banksel	OPTION_REG
 	bsf	OPTION_REG,NOT_WPUEN	; but first, disable weak pullups
 	movlp	high APP_ENTRY_POINT	; attempt to appease certain user apps
+	if DUAL_SLOT
+	btfsc	ACTIVE_SLOT,0
+	movlp	high APP_B_ENTRY_POINT
+	endif
 	goto	APP_ENTRY_POINT
 
 ; Not entering application code: initialize the USB interface and wait for commands.
 _bootloader_main
+	if SUSPEND_SLEEP
+; a USB interrupt flag wakes the device from SLEEP (GIE stays clear, so no interrupt is taken)
+	banksel	PIE2
+	bsf	PIE2,USBIE
+	bsf	INTCON,PEIE
+	endif
+	call	wait_osc
 
 ; Initialize USB
 	call	usb_init
@@ -646,7 +760,6 @@ _bootloader_main
 _usb_attach
 	banksel	UCON		; reset UCON
 	clrf	UCON
-	banksel	UCON
 _usben	bsf	UCON,USBEN	; enable USB module and wait until ready
 	btfss	UCON,USBEN
 	goto	_usben
@@ -671,10 +784,49 @@ _utrans	banksel	UIR
 	bnz	_usdone		; bail if not endpoint 0
 	call	usb_service_ep0	; handle the control message
 	goto	_utrans
+	if SUSPEND_SLEEP
+; if the host has suspended the bus, sleep until it resumes (or resets) it
+_usdone	banksel	UIR
+	btfss	UIR,IDLEIF
+	goto	bootloader_main_loop
+	bcf	UIR,ACTVIF	; a stale flag would keep it from sleeping
+	bsf	UIE,ACTVIE	; bus activity sets USBIF
+	bsf	UCON,SUSPND
+	banksel	PIR2
+	bcf	PIR2,USBIF	; (activity from here on makes SLEEP a NOP)
+	banksel	UIR
+	btfss	UIR,ACTVIF	; but activity up to here only set the USBIF just cleared
+	sleep
+	call	wait_osc	; the SIE needs the PLL to have locked again
+	banksel	UCON
+	bcf	UCON,SUSPND
+_uactv	bcf	UIR,ACTVIF	; does not clear until the USB clock is running again
+	btfsc	UIR,ACTVIF
+	goto	_uactv
+	bcf	UIR,IDLEIF
+	goto	bootloader_main_loop
+	else
 ; clear USB interrupt
 _usdone	banksel	PIR2
 	bcf	PIR2,USBIF
 	goto	bootloader_main_loop
+	endif
+
+
+;;; Waits for the oscillator and PLL to stabilize, then enables active clock tuning
+;;; arguments:	none
+;;; returns:	none
+;;; clobbers:	W, BSR
+wait_osc
+	banksel	OSCSTAT
+_wosc	movlw	(1<<PLLRDY)|(1<<HFIOFR)|(1<<HFIOFS)
+	andwf	OSCSTAT,w
+	sublw	(1<<PLLRDY)|(1<<HFIOFR)|(1<<HFIOFS)
+	bnz	_wosc
+	banksel	ACTCON
+	movlw	(1<<ACTEN)|(1<<ACTSRC)
+	movwf	ACTCON
+	return
 
 
 ;;; Initializes the USB system and resets all associated registers.
@@ -816,6 +968,7 @@ SN4	equ	SERIAL_NUMBER & 0xF
 
 ; the objective here *SHOULD* be to SQTP program globally unique values in production
 ; this data then doubles as a unique serial number that can be used by the user app
+	if !OMIT_SERIAL_STRING
 SERIAL_NUMBER_STRING_DESCRIPTOR
 	dt	SERIAL_NUM_DESC_LEN	; bLength
 	dt	0x03		; bDescriptorType (STRING)
@@ -827,6 +980,7 @@ SERIAL_NUMBER_STRING_DESCRIPTOR
 	dt	'0'+SN2+((SN2>9)*7), 0x00
 	dt	'0'+SN3+((SN3>9)*7), 0x00
 	dt	'0'+SN4+((SN4>9)*7), 0x00
+	endif
 	
 ; Raise an error if the descriptors aren't properly aligned. (This means you
 ; changed the descriptors withouth updating the definition of ALL_DESCS_TOTAL_LEN.)
@@ -0,0 +1,411 @@
+/*
+    command-line tool to download a 454hex2dfu image to the PIC16F1454 DFU bootloader,
+    resuming where it left off if the device drops off the bus part-way through
+
+    build: gcc 454dfu.c -o 454dfu `pkg-config --cflags --libs libusb-1.0`
+    or, against a simulated device (see dfusim.c): gcc -DDFUSIM 454dfu.c dfusim.c -o 454dfu-sim
+
+    the bootloader takes wBlockNum in DFU_UPLOAD and DFU_DNLOAD as the flash row
+    index, so rows can be read back and written in any order; rather than sending
+    the whole image as dfu-util does, each pass reads back every application row,
+    and only writes those that differ from the image
+
+    the row holding the CRC-14 (at 0x1F7F) is written last, so that the bootloader
+    never starts a partially written application; if any other row has to change,
+    the CRC row is first written with a deliberately wrong CRC, in case the old one
+    happens to also match the partially written image
+
+    if the device is lost (cable pulled, hub reset), the tool waits for it to come
+    back and starts another pass, so a resumed download only costs the rows that
+    are still missing, plus reading back the rest
+
+    a HEF image (from 454hex2dfu --hef) only holds the four high-endurance flash
+    rows, so only those are compared and written; the application is untouched;
+    as the rows are addressed directly (252 to 255), the flag that 454hex2dfu sets
+    in the first word of each row for dfu-util's sake is cleared
+
+    with -s a or -s b, the image (from 454hex2dfu -s) is written to that slot of a
+    DUAL_SLOT bootloader, leaving the other slot alone; once the slot is complete,
+    the selector word at 0x1FFF is changed to start it, so that up to that point
+    the device keeps starting the application in the other slot
+
+    Copyright (C) 2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#define sleep_ms(ms) Sleep(ms)
+#else
+#include <unistd.h>
+#define sleep_ms(ms) usleep(1000UL * (ms))
+#endif
+#ifdef DFUSIM
+#include "dfusim.h"
+#else
+#include <libusb.h>
+#endif
+
+#define PM_SIZE_IN_BYTES		 16384
+#define	CODE_OFFSET_ADDRESS		 0x200
+#define	HIGH_ENDURANCE_ADDRESS	0x1F80
+#define	SLOT_B_ADDRESS			0x1200
+#define	SLOT_SELECT_ADDRESS		0x1FFF
+#define DFU_SUFFIX				    16
+#define USB_PRODUCT_ID			0x2002
+#define USB_VENDOR_ID			0x1209
+
+#define ROW_SIZE_IN_BYTES		    64
+#define ROW_COUNT				(PM_SIZE_IN_BYTES / ROW_SIZE_IN_BYTES)
+#define ADDRESS_TO_ROW(a)		(((a) << 1) / ROW_SIZE_IN_BYTES)
+#define CRC_OFFSET				(ROW_SIZE_IN_BYTES - 2)	/* the CRC-14 is the last word of a row */
+#define SELECT_ROW				ADDRESS_TO_ROW(SLOT_SELECT_ADDRESS)
+#define SELECT_OFFSET			(ROW_SIZE_IN_BYTES - 2)
+#define HEF_SIZE_IN_BYTES		(PM_SIZE_IN_BYTES - (HIGH_ENDURANCE_ADDRESS << 1))
+#define HEF_ROW_FLAG			  0x80	/* in the high byte of a row's first word */
+#define NO_ROW					ROW_COUNT
+
+#define DFU_DNLOAD				     1
+#define DFU_UPLOAD				     2
+#define DFU_GETSTATUS			     3
+#define DFU_REQUEST_OUT			  0x21
+#define DFU_REQUEST_IN			  0xA1
+#define TRANSFER_TIMEOUT_MS		  1000
+#define MAX_PASSES				     3
+
+static libusb_device_handle *open_bootloader(libusb_context *ctx, unsigned wait_ms);
+static void close_bootloader(libusb_device_handle *handle);
+static int read_row(libusb_device_handle *handle, unsigned row, unsigned char *buffer);
+static int write_row(libusb_device_handle *handle, unsigned row, const unsigned char *buffer);
+static int end_download(libusb_device_handle *handle);
+struct region
+{
+	unsigned first_row, end_row;	/* rows compared with the image */
+	unsigned crc_row;				/* or NO_ROW */
+	int slot;						/* slot to select once written, or -1 */
+};
+
+static int flash_pass(libusb_device_handle *handle, const struct region *region, const unsigned char *image, const unsigned char *invalid_crc_row);
+
+int main(int argc, char *argv[])
+{
+	FILE *input;
+	libusb_context *ctx;
+	libusb_device_handle *handle;
+	unsigned char *image, invalid_crc_row[ROW_SIZE_IN_BYTES];
+	unsigned wait_ms, crc, passes, row;
+	struct region region;
+	long length;
+	int result, arg;
+
+	/* the whole application area, and high-endurance flash */
+	region.first_row = ADDRESS_TO_ROW(CODE_OFFSET_ADDRESS);
+	region.end_row = ROW_COUNT;
+	region.crc_row = ADDRESS_TO_ROW(HIGH_ENDURANCE_ADDRESS - 1);
+	region.slot = -1;
+
+	wait_ms = 10000;
+	for (arg = 1; (arg < argc) && ('-' == argv[arg][0]); arg++)
+	{
+		if ( (0 == strcmp(argv[arg], "-w")) && (arg + 1 < argc) )
+			wait_ms = 1000 * atoi(argv[++arg]);
+		else if ( (0 == strcmp(argv[arg], "-s")) && (arg + 1 < argc) && (0 == strcmp(argv[arg + 1], "a")) )
+		{
+			region.end_row = ADDRESS_TO_ROW(SLOT_B_ADDRESS);
+			region.crc_row = ADDRESS_TO_ROW(SLOT_B_ADDRESS - 1);
+			region.slot = 0; arg++;
+		}
+		else if ( (0 == strcmp(argv[arg], "-s")) && (arg + 1 < argc) && (0 == strcmp(argv[arg + 1], "b")) )
+		{
+			region.first_row = ADDRESS_TO_ROW(SLOT_B_ADDRESS);
+			region.end_row = ADDRESS_TO_ROW(HIGH_ENDURANCE_ADDRESS);
+			region.slot = 1; arg++;
+		}
+		else
+			break;
+	}
+
+	if (arg + 1 != argc)
+	{
+		fprintf(stderr, "%s [-w <seconds to wait for the device>] [-s a|b] <input_dfu>\n", argv[0]);
+		return -1;
+	}
+
+	image = (unsigned char *)malloc(PM_SIZE_IN_BYTES + DFU_SUFFIX);
+
+	if (NULL == image)
+	{
+		fprintf(stderr, "ERROR: unable to allocate memory\n");
+		return -1;
+	}
+
+	input = fopen(argv[arg], "rb");
+
+	if (NULL == input)
+	{
+		fprintf(stderr, "ERROR: unable to open input file %s\n", argv[arg]);
+		return -1;
+	}
+
+	length = (long)fread(image, 1, PM_SIZE_IN_BYTES + DFU_SUFFIX, input);
+	fclose(input);
+
+	if ( (HEF_SIZE_IN_BYTES + DFU_SUFFIX == length) && (region.slot < 0) )
+	{
+		/* a HEF image is the tail end of a full one */
+		memmove(image + PM_SIZE_IN_BYTES - HEF_SIZE_IN_BYTES, image, length);
+		region.first_row = ADDRESS_TO_ROW(HIGH_ENDURANCE_ADDRESS);
+		region.crc_row = NO_ROW;
+		/* the rows are addressed directly, and the flash reads back without the flag */
+		for (row = region.first_row; row < region.end_row; row++)
+			image[row * ROW_SIZE_IN_BYTES + 1] &= ~HEF_ROW_FLAG;
+	}
+	else if (PM_SIZE_IN_BYTES + DFU_SUFFIX != length)
+	{
+		length = 0;
+	}
+
+	if ( (0 == length) || memcmp(image + PM_SIZE_IN_BYTES + 8, "UFD", 3) )
+	{
+		fprintf(stderr, "ERROR: %s is not an output of 454hex2dfu%s\n", argv[arg], (region.slot < 0) ? "" : " -s");
+		return -1;
+	}
+
+	/* a copy of the CRC row whose CRC-14 can never check out */
+	if (NO_ROW != region.crc_row)
+	{
+		memcpy(invalid_crc_row, image + region.crc_row * ROW_SIZE_IN_BYTES, ROW_SIZE_IN_BYTES);
+		crc = invalid_crc_row[CRC_OFFSET + 0] + ((unsigned)invalid_crc_row[CRC_OFFSET + 1] << 8);
+		crc ^= 0x3FFF;
+		invalid_crc_row[CRC_OFFSET + 0] = (crc & 0x00FF);
+		invalid_crc_row[CRC_OFFSET + 1] = (crc & 0xFF00) >> 8;
+	}
+
+	result = libusb_init(&ctx);
+
+	if (result < 0)
+	{
+		fprintf(stderr, "ERROR: unable to initialize libusb: %s\n", libusb_error_name(result));
+		return -1;
+	}
+
+	handle = open_bootloader(ctx, wait_ms);
+	passes = 0;
+
+	while (handle)
+	{
+		result = flash_pass(handle, &region, image, invalid_crc_row);
+
+		if (0 == result)
+			break;
+
+		if (result > 0)
+		{
+			/* rows were written; the next pass reads them back as a verify */
+			if (++passes < MAX_PASSES)
+				continue;
+			fprintf(stderr, "ERROR: rows still differ after %u passes\n", passes);
+			result = -1;
+			break;
+		}
+
+		fprintf(stderr, "device lost (%s); waiting for it to resume\n", libusb_error_name(result));
+		close_bootloader(handle);
+		handle = open_bootloader(ctx, wait_ms);
+	}
+
+	if (NULL == handle)
+	{
+		fprintf(stderr, "ERROR: no DFU bootloader (%04x:%04x) found\n", USB_VENDOR_ID, USB_PRODUCT_ID);
+		result = -1;
+	}
+	else
+	{
+		if (0 == result)
+			printf("device matches %s\n", argv[arg]);
+		close_bootloader(handle);
+	}
+
+	libusb_exit(ctx);
+	free(image);
+
+	return (0 == result) ? 0 : -1;
+}
+
+static libusb_device_handle *open_bootloader(libusb_context *ctx, unsigned wait_ms)
+{
+	libusb_device_handle *handle;
+	unsigned waited;
+
+	for (waited = 0;; waited += 100)
+	{
+		handle = libusb_open_device_with_vid_pid(ctx, USB_VENDOR_ID, USB_PRODUCT_ID);
+
+		if (handle)
+		{
+			if (0 == libusb_claim_interface(handle, 0))
+				return handle;
+			libusb_close(handle);
+		}
+
+		if (waited >= wait_ms)
+			return NULL;
+
+		sleep_ms(100);
+	}
+}
+
+static void close_bootloader(libusb_device_handle *handle)
+{
+	libusb_release_interface(handle, 0);
+	libusb_close(handle);
+}
+
+static int read_row(libusb_device_handle *handle, unsigned row, unsigned char *buffer)
+{
+	int result;
+
+	result = libusb_control_transfer(handle, DFU_REQUEST_IN, DFU_UPLOAD, row, 0, buffer, ROW_SIZE_IN_BYTES, TRANSFER_TIMEOUT_MS);
+
+	if ( (result >= 0) && (ROW_SIZE_IN_BYTES != result) )
+		result = LIBUSB_ERROR_IO;
+
+	return (result < 0) ? result : 0;
+}
+
+static int write_row(libusb_device_handle *handle, unsigned row, const unsigned char *buffer)
+{
+	unsigned char status[6];
+	int result;
+
+	result = libusb_control_transfer(handle, DFU_REQUEST_OUT, DFU_DNLOAD, row, 0, (unsigned char *)buffer, ROW_SIZE_IN_BYTES, TRANSFER_TIMEOUT_MS);
+
+	if ( (result >= 0) && (ROW_SIZE_IN_BYTES != result) )
+		result = LIBUSB_ERROR_IO;
+
+	/* the bootloader NAKs this until the row erase and write have finished */
+	if (result >= 0)
+		result = libusb_control_transfer(handle, DFU_REQUEST_IN, DFU_GETSTATUS, 0, 0, status, sizeof(status), TRANSFER_TIMEOUT_MS);
+
+	return (result < 0) ? result : 0;
+}
+
+static int end_download(libusb_device_handle *handle)
+{
+	unsigned char status[6];
+	int result;
+
+	result = libusb_control_transfer(handle, DFU_REQUEST_OUT, DFU_DNLOAD, 0, 0, NULL, 0, TRANSFER_TIMEOUT_MS);
+
+	if (result >= 0)
+		result = libusb_control_transfer(handle, DFU_REQUEST_IN, DFU_GETSTATUS, 0, 0, status, sizeof(status), TRANSFER_TIMEOUT_MS);
+
+	return (result < 0) ? result : 0;
+}
+
+/*
+returns the number of rows written, zero if the device already matches the image,
+or a (negative) libusb error if the device was lost
+*/
+static int flash_pass(libusb_device_handle *handle, const struct region *region, const unsigned char *image, const unsigned char *invalid_crc_row)
+{
+	unsigned char buffer[ROW_SIZE_IN_BYTES], differs[ROW_COUNT + 1], select_row[ROW_SIZE_IN_BYTES];
+	unsigned row, pending, written, select, select_differs;
+	int result, crc_row_invalid;
+
+	pending = 0; crc_row_invalid = 0;
+	differs[NO_ROW] = 0;
+	for (row = region->first_row; row < region->end_row; row++)
+	{
+		result = read_row(handle, row, buffer);
+		if (result < 0)
+			return result;
+		differs[row] = (0 != memcmp(buffer, image + row * ROW_SIZE_IN_BYTES, ROW_SIZE_IN_BYTES));
+		if (region->crc_row == row)
+			crc_row_invalid = (0 == memcmp(buffer, invalid_crc_row, ROW_SIZE_IN_BYTES));
+		else
+			pending += differs[row];
+	}
+
+	/* the rest of the selector's row belongs to the application, so is kept as it is */
+	select_differs = 0;
+	if (region->slot >= 0)
+	{
+		result = read_row(handle, SELECT_ROW, select_row);
+		if (result < 0)
+			return result;
+		select = select_row[SELECT_OFFSET + 0] + ((unsigned)select_row[SELECT_OFFSET + 1] << 8);
+		select = (select & 0x3FFE) | region->slot;
+		select_differs = (select != select_row[SELECT_OFFSET + 0] + ((unsigned)select_row[SELECT_OFFSET + 1] << 8));
+		select_row[SELECT_OFFSET + 0] = (select & 0x00FF);
+		select_row[SELECT_OFFSET + 1] = (select & 0xFF00) >> 8;
+	}
+
+	written = 0;
+	printf("%u of %u rows to write\n", pending + differs[region->crc_row] + select_differs, region->end_row - region->first_row + (region->slot >= 0));
+
+	if ( pending && (NO_ROW != region->crc_row) && !crc_row_invalid )
+	{
+		result = write_row(handle, region->crc_row, invalid_crc_row);
+		if (result < 0)
+			return result;
+		differs[region->crc_row] = 1;
+		written++;
+	}
+
+	for (row = region->first_row; row < region->end_row; row++)
+	{
+		if ( (region->crc_row == row) || !differs[row] )
+			continue;
+		result = write_row(handle, row, image + row * ROW_SIZE_IN_BYTES);
+		if (result < 0)
+			return result;
+		written++;
+	}
+
+	if (differs[region->crc_row])
+	{
+		result = write_row(handle, region->crc_row, image + region->crc_row * ROW_SIZE_IN_BYTES);
+		if (result < 0)
+			return result;
+		written++;
+	}
+
+	/* only now is the slot complete, and safe to select */
+	if (select_differs)
+	{
+		result = write_row(handle, SELECT_ROW, select_row);
+		if (result < 0)
+			return result;
+		written++;
+	}
+
+	if (written)
+	{
+		result = end_download(handle);
+		if (result < 0)
+			return result;
+	}
+
+	return written;
+}
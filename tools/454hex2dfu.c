@@ -32,7 +32,10 @@
 #define PM_SIZE_IN_BYTES		 16384
 #define	CODE_OFFSET_ADDRESS		 0x200
 #define	HIGH_ENDURANCE_ADDRESS	0x1F80
+#define	SLOT_B_ADDRESS			0x1200	/* DUAL_SLOT build of the bootloader */
 #define DFU_SUFFIX				    16
+#define ROW_SIZE_IN_BYTES		    64
+#define HEF_ROW_FLAG			  0x80	/* in the high byte of a row's first word */
 #define USB_PRODUCT_ID			0x2002
 #define USB_VENDOR_ID			0x1209
 
@@ -46,17 +49,49 @@ int main(int argc, char *argv[])
 	char line[256];
 	unsigned address, upper_address;
 	unsigned count, next_address, crc;
+	unsigned app_start, app_end;
 	const char *ptr;
 	struct
 	{
 		unsigned out_of_bounds:1;
 		unsigned crc_overlap:1;
+		unsigned slot:1;
+		unsigned hef:1;
 	} flags;
 	unsigned char *image, *suffix;
+	unsigned start;
+	int arg;
 
-	if (argc < 3)
+	memset(&flags, 0, sizeof(flags));
+
+	/* the whole application area, or one slot of it for a DUAL_SLOT bootloader */
+	app_start = CODE_OFFSET_ADDRESS;
+	app_end = HIGH_ENDURANCE_ADDRESS;
+	arg = 1;
+
+	if ( (argc > 2) && (0 == strcmp(argv[1], "-s")) )
+	{
+		flags.slot = 1;
+		if (0 == strcmp(argv[2], "a"))
+			app_end = SLOT_B_ADDRESS;
+		else if (0 == strcmp(argv[2], "b"))
+			app_start = SLOT_B_ADDRESS;
+		else
+			argc = 0;
+		arg = 3;
+	}
+	else if ( (argc > 1) && (0 == strcmp(argv[1], "--hef")) )
 	{
-		fprintf(stderr, "%s <input_ihex> <output_dfu>\n", argv[0]);
+		/* only the four high-endurance flash rows, flagged so that the bootloader takes DNLOAD blocks 0 to 3 as those rows */
+		flags.hef = 1;
+		app_start = HIGH_ENDURANCE_ADDRESS;
+		app_end = PM_SIZE_IN_BYTES >> 1;
+		arg = 2;
+	}
+
+	if (argc < arg + 2)
+	{
+		fprintf(stderr, "%s [-s a|b | --hef] <input_ihex> <output_dfu>\n", argv[0]);
 		return -1;
 	}
 
@@ -68,19 +103,19 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	input = fopen(argv[1], "rb");
+	input = fopen(argv[arg], "rb");
 
 	if (NULL == input)
 	{
-		fprintf(stderr, "ERROR: unable to open input file %s\n", argv[1]);
+		fprintf(stderr, "ERROR: unable to open input file %s\n", argv[arg]);
 		return -1;
 	}
 
-	output = fopen(argv[2], "wb");
+	output = fopen(argv[arg + 1], "wb");
 
 	if (NULL == output)
 	{
-		fprintf(stderr, "ERROR: unable to open output file %s\n", argv[2]);
+		fprintf(stderr, "ERROR: unable to open output file %s\n", argv[arg + 1]);
 		return -1;
 	}
 
@@ -90,7 +125,6 @@ int main(int argc, char *argv[])
 		image[address + 1] = 0x3F;
 	}
 
-	memset(&flags, 0, sizeof(flags));
 	upper_address = 0;
 
 	while (!feof(input))
@@ -108,6 +142,8 @@ int main(int argc, char *argv[])
 					{
 						if ( (address < 0x400) || (address >= 0x8000) )
 							flags.out_of_bounds = 1;
+						else if ( (flags.slot || flags.hef) && ((address < (app_start << 1)) || (address >= (app_end << 1))) )
+							flags.out_of_bounds = 1;	/* a slot or HEF image may not touch anything else */
 						else
 							image[address] = readhex(ptr, 2);
 						address++; ptr += 2;
@@ -133,11 +169,12 @@ int main(int argc, char *argv[])
 		goto skip_write;
 	}
 
-	address = CODE_OFFSET_ADDRESS << 1; crc = 0;
-	for (;;)
+	/* a HEF image has no CRC-14; it leaves the application's alone */
+	address = app_start << 1; crc = 0;
+	while (!flags.hef)
 	{
 		next_address = address + 2;
-		if ((HIGH_ENDURANCE_ADDRESS << 1) == next_address)
+		if ((app_end << 1) == next_address)
 		{
 			flags.crc_overlap = (0xFF != image[address + 0]) || (0x3F != image[address + 1]);
 			image[address + 0] = (crc & 0x00FF);
@@ -157,6 +194,14 @@ int main(int argc, char *argv[])
 		goto skip_write;
 	}
 
+	/*
+	a HEF image is the tail end of the full one; bit 15 of the first word of each row
+	(never set in a 14-bit instruction word) tells the bootloader to write that row to
+	high-endurance flash, as dfu-util sends the image as blocks 0 to 3
+	*/
+	start = flags.hef ? (HIGH_ENDURANCE_ADDRESS << 1) : 0;
+	for (address = start; flags.hef && (address < PM_SIZE_IN_BYTES); address += ROW_SIZE_IN_BYTES)
+		image[address + 1] |= HEF_ROW_FLAG;
 	suffix = image + PM_SIZE_IN_BYTES;
 	count = 0;
 	suffix[count++] = 0xFF;								// bcdDevice
@@ -172,7 +217,7 @@ int main(int argc, char *argv[])
 	suffix[count++] = 'D';
 	suffix[count++] = DFU_SUFFIX;						// bLength
 
-	crc = crc32_calc(0xFFFFFFFF, image, PM_SIZE_IN_BYTES + count);
+	crc = crc32_calc(0xFFFFFFFF, image + start, PM_SIZE_IN_BYTES - start + count);
 
 	suffix[count++] = (crc & 0x000000FF) >> 0;			// dwCRC
 	suffix[count++] = (crc & 0x0000FF00) >> 8;
@@ -181,7 +226,7 @@ int main(int argc, char *argv[])
 
 	assert(DFU_SUFFIX == count);
 
-	fwrite(image, 1, PM_SIZE_IN_BYTES + count, output);
+	fwrite(image + start, 1, PM_SIZE_IN_BYTES - start + count, output);
 	fclose(output);
 
 skip_write:
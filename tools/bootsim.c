@@ -0,0 +1,1801 @@
+/*
+    assembler and simulator for checking bootloader.asm without gputils or gpsim
+
+    assembles the subset of gpasm that bootloader.asm and its include files use
+    (the PIC16F1454 registers and configuration bits they need are built in, in
+    place of p16f1454.inc), and runs the result on an instruction-level model
+    of the PIC16F1454 core:
+
+    bootsim [-D symbol[=value]]... [-o hex] bootloader.asm
+        assemble, report the words used, and write the hex file as gpasm does
+        (so that it can be compared with bootloader.hex; see firmware/Makefile)
+    bootsim [-D ...] -b image bootloader.asm
+        time from reset to the application entry point, with image (a .dfu or
+        16384 byte binary) in flash, for several PLL lock times
+    bootsim [-D ...] -w bootloader.asm
+        for a SUSPEND_SLEEP build: suspend the bus, check that the device
+        sleeps, and time it from the resume back to the main loop; then set
+        ACTVIF (bus activity) before each instruction from the suspend to the
+        SLEEP in turn, and check that the device never sleeps through it
+
+    gcc bootsim.c -o bootsim
+
+    the model: the core runs from the 16MHz HFINTOSC until the PLL has locked,
+    then at 48MHz, 4 clocks per instruction cycle; OSCSTAT reports HFINTOSC
+    ready and stable, and PLLRDY once locked; ACTVIF can't be cleared until the
+    USB clock (the PLL) runs again; PIR2.USBIF is set when a flag in UIR becomes
+    set with its enable in UIE, and is not set again for a flag that stays set;
+    SLEEP is a NOP with USBIF and USBIE set, and otherwise the device sleeps
+    until they are; the PLL has to lock again after waking; RA3 reads high
+
+    Copyright (C) 2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#define PM_SIZE_IN_WORDS		0x2000
+#define BOOTLOADER_WORDS		 0x200
+#define APP_ENTRY_POINT			 0x200
+#define APP_B_ENTRY_POINT		0x1200
+#define CONFIG_ADDRESS			0x8007
+#define CONFIG_WORDS			     2
+
+#define NAME_MAX_LEN			    64
+#define LINE_MAX_LEN			   512
+#define OPERANDS_MAX			    16
+#define SYMBOLS_MAX			  1024
+#define MACROS_MAX			    32
+#define PARAMS_MAX			     4
+#define NESTING_MAX			    16
+#define DEFINES_MAX			    16
+
+/* registers */
+#define STATUS				 0x003
+#define FSR0L				 0x004
+#define BSR				 0x008
+#define WREG				 0x009
+#define PCLATH				 0x00A
+#define PORTA				 0x00C
+#define PIR2				 0x012
+#define PIE2				 0x092
+#define OSCCON				 0x099
+#define OSCSTAT				 0x09A
+#define PMADRL				 0x191
+#define PMADRH				 0x192
+#define PMDATL				 0x193
+#define PMDATH				 0x194
+#define PMCON1				 0x195
+#define UCON				 0xE8E
+#define UIR				 0xE90
+#define UIE				 0xE92
+
+/* bits */
+#define STATUS_C			(1 << 0)
+#define STATUS_Z			(1 << 2)
+#define USBIF				(1 << 2)
+#define USBIE				(1 << 2)
+#define SPLLEN				(1 << 7)
+#define HFIOFS				(1 << 0)
+#define HFIOFR				(1 << 4)
+#define PLLRDY				(1 << 6)
+#define PMCON1_RD			(1 << 0)
+#define SUSPND				(1 << 1)
+#define ACTVIF				(1 << 2)
+#define IDLEIF				(1 << 4)
+
+struct symbol
+{
+	const char *name;
+	long value;
+};
+
+/* what bootloader.asm uses of p16f1454.inc */
+static const struct symbol p16f1454[] =
+{
+	{ "INDF0", 0x000 }, { "INDF1", 0x001 }, { "PCL", 0x002 }, { "STATUS", 0x003 },
+	{ "FSR0L", 0x004 }, { "FSR0H", 0x005 }, { "FSR1L", 0x006 }, { "FSR1H", 0x007 },
+	{ "BSR", 0x008 }, { "WREG", 0x009 }, { "PCLATH", 0x00A }, { "INTCON", 0x00B },
+	{ "PORTA", 0x00C }, { "PORTC", 0x00E }, { "PIR1", 0x011 }, { "PIR2", 0x012 },
+	{ "TMR0", 0x015 }, { "TMR1L", 0x016 }, { "TMR1H", 0x017 }, { "T1CON", 0x018 },
+	{ "TRISA", 0x08C }, { "TRISC", 0x08E }, { "PIE1", 0x091 }, { "PIE2", 0x092 },
+	{ "OPTION_REG", 0x095 }, { "PCON", 0x096 }, { "WDTCON", 0x097 }, { "OSCTUNE", 0x098 },
+	{ "OSCCON", 0x099 }, { "OSCSTAT", 0x09A }, { "LATA", 0x10C }, { "LATC", 0x10E },
+	{ "PMADRL", 0x191 }, { "PMADRH", 0x192 }, { "PMDATL", 0x193 }, { "PMDATH", 0x194 },
+	{ "PMCON1", 0x195 }, { "PMCON2", 0x196 }, { "ACTCON", 0x39B },
+	{ "UCON", 0xE8E }, { "USTAT", 0xE8F }, { "UIR", 0xE90 }, { "UCFG", 0xE91 },
+	{ "UIE", 0xE92 }, { "UEIR", 0xE93 }, { "UFRMH", 0xE94 }, { "UFRML", 0xE95 },
+	{ "UADDR", 0xE96 }, { "UEIE", 0xE97 }, { "UEP0", 0xE98 }, { "UEP1", 0xE99 },
+	{ "UEP2", 0xE9A }, { "UEP3", 0xE9B }, { "STKPTR", 0xFED }, { "TOSL", 0xFEE }, { "TOSH", 0xFEF },
+
+	{ "C", 0 }, { "DC", 1 }, { "Z", 2 }, { "NOT_PD", 3 }, { "NOT_TO", 4 },
+	{ "PEIE", 6 }, { "GIE", 7 }, { "USBIF", 2 }, { "USBIE", 2 }, { "NOT_WPUEN", 7 }, { "RA3", 3 },
+	{ "SPLLEN", 7 }, { "SPLLMULT", 6 }, { "IRCF3", 5 }, { "IRCF2", 4 }, { "IRCF1", 3 }, { "IRCF0", 2 },
+	{ "SCS1", 1 }, { "SCS0", 0 },
+	{ "SOSCR", 7 }, { "PLLRDY", 6 }, { "OSTS", 5 }, { "HFIOFR", 4 }, { "HFIOFL", 3 }, { "MFIOFR", 2 },
+	{ "LFIOFR", 1 }, { "HFIOFS", 0 },
+	{ "ACTEN", 7 }, { "ACTUD", 6 }, { "ACTSRC", 4 }, { "ACTLOCK", 3 }, { "ACTORS", 1 },
+	{ "RD", 0 }, { "WR", 1 }, { "WREN", 2 }, { "WRERR", 3 }, { "FREE", 4 }, { "LWLO", 5 }, { "CFGS", 6 },
+	{ "PPBRST", 6 }, { "SE0", 5 }, { "PKTDIS", 4 }, { "USBEN", 3 }, { "RESUME", 2 }, { "SUSPND", 1 },
+	{ "SOFIF", 6 }, { "STALLIF", 5 }, { "IDLEIF", 4 }, { "TRNIF", 3 }, { "ACTVIF", 2 }, { "UERRIF", 1 }, { "URSTIF", 0 },
+	{ "SOFIE", 6 }, { "STALLIE", 5 }, { "IDLEIE", 4 }, { "TRNIE", 3 }, { "ACTVIE", 2 }, { "UERRIE", 1 }, { "URSTIE", 0 },
+	{ "UTEYE", 7 }, { "UOEMON", 6 }, { "UPUEN", 4 }, { "UTRDIS", 3 }, { "FSEN", 2 }, { "PPB1", 1 }, { "PPB0", 0 },
+	{ "EPHSHK", 4 }, { "EPCONDIS", 3 }, { "EPOUTEN", 2 }, { "EPINEN", 1 }, { "EPSTALL", 0 },
+	{ "DIR", 2 }, { "PPBI", 1 },
+	{ "W", 0 }, { "F", 1 }, { "w", 0 }, { "f", 1 },
+
+	{ "_CONFIG1", 0x8007 }, { "_CONFIG2", 0x8008 },
+	{ "_FOSC_INTOSC", 0x3FFC }, { "_WDTE_SWDTEN", 0x3FEF }, { "_PWRTE_ON", 0x3FDF }, { "_MCLRE_OFF", 0x3FBF },
+	{ "_CP_ON", 0x3F7F }, { "_BOREN_ON", 0x3FFF }, { "_IESO_OFF", 0x2FFF }, { "_FCMEN_OFF", 0x1FFF },
+	{ "_WRT_BOOT", 0x3FFE }, { "_CPUDIV_NOCLKDIV", 0x3FCF }, { "_USBLSCLK_48MHz", 0x3FFF }, { "_PLLMULT_3x", 0x3FFF },
+	{ "_PLLEN_ENABLED", 0x3FFF }, { "_STVREN_ON", 0x3FFF }, { "_BORV_LO", 0x3FFF }, { "_LPBOR_OFF", 0x3FFF },
+	{ "_LVP_OFF", 0x1FFF },
+};
+
+struct opcode
+{
+	const char *name;
+	unsigned bits;
+};
+
+static const struct opcode byte_ops[] =
+{
+	{ "addwf", 0x0700 }, { "addwfc", 0x3D00 }, { "andwf", 0x0500 }, { "asrf", 0x3700 }, { "lslf", 0x3500 },
+	{ "lsrf", 0x3600 }, { "comf", 0x0900 }, { "decf", 0x0300 }, { "decfsz", 0x0B00 }, { "incf", 0x0A00 },
+	{ "incfsz", 0x0F00 }, { "iorwf", 0x0400 }, { "movf", 0x0800 }, { "rlf", 0x0D00 }, { "rrf", 0x0C00 },
+	{ "subwf", 0x0200 }, { "subwfb", 0x3B00 }, { "swapf", 0x0E00 }, { "xorwf", 0x0600 }, { NULL, 0 }
+};
+
+static const struct opcode bit_ops[] =
+{
+	{ "bcf", 0x1000 }, { "bsf", 0x1400 }, { "btfsc", 0x1800 }, { "btfss", 0x1C00 }, { NULL, 0 }
+};
+
+static const struct opcode literal_ops[] =
+{
+	{ "addlw", 0x3E00 }, { "andlw", 0x3900 }, { "iorlw", 0x3800 }, { "movlw", 0x3000 }, { "sublw", 0x3C00 },
+	{ "xorlw", 0x3A00 }, { "retlw", 0x3400 }, { NULL, 0 }
+};
+
+static const struct opcode implied_ops[] =
+{
+	{ "nop", 0x0000 }, { "return", 0x0008 }, { "retfie", 0x0009 }, { "callw", 0x000A }, { "brw", 0x000B },
+	{ "sleep", 0x0063 }, { "clrwdt", 0x0064 }, { "reset", 0x0001 }, { "clrw", 0x0103 }, { NULL, 0 }
+};
+
+/* the special instructions: a skip on a STATUS bit, and for the branches, followed by a goto */
+static const struct opcode skip_ops[] =
+{
+	{ "skpz", 0x1C00 | (2 << 7) }, { "skpnz", 0x1800 | (2 << 7) }, { "skpc", 0x1C00 | (0 << 7) }, { "skpnc", 0x1800 | (0 << 7) }, { NULL, 0 }
+};
+
+static const struct opcode branch_ops[] =
+{
+	{ "bz", 0x1800 | (2 << 7) }, { "bnz", 0x1C00 | (2 << 7) }, { "bc", 0x1800 | (0 << 7) }, { "bnc", 0x1C00 | (0 << 7) }, { NULL, 0 }
+};
+
+struct line
+{
+	const char *file;
+	unsigned number;
+	char *text;
+};
+
+struct macro
+{
+	char name[NAME_MAX_LEN];
+	char params[PARAMS_MAX][NAME_MAX_LEN];
+	unsigned params_count;
+	const struct line *body;
+	unsigned body_count;
+};
+
+static struct
+{
+	const char *directory;
+	int pass;
+	long pc;
+	int undefined;
+	const struct line *where;
+
+	struct symbol symbols[SYMBOLS_MAX];
+	unsigned symbols_count;
+	struct macro macros[MACROS_MAX];
+	unsigned macros_count;
+
+	/* if/else/endif: whether each level is on, and whether it has been yet */
+	struct { int active, taken; } nesting[NESTING_MAX];
+	unsigned nesting_depth;
+
+	unsigned short code[PM_SIZE_IN_WORDS];
+	unsigned char used[PM_SIZE_IN_WORDS];
+	unsigned short config[CONFIG_WORDS];
+	unsigned char config_used[CONFIG_WORDS];
+} assembler;
+
+static void fatal(const char *format, ...)
+{
+	va_list args;
+
+	if (assembler.where)
+		fprintf(stderr, "%s:%u: ", assembler.where->file, assembler.where->number);
+	fprintf(stderr, "ERROR: ");
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+	exit(-1);
+}
+
+static const struct opcode *find_opcode(const struct opcode *table, const char *name)
+{
+	for (; table->name; table++)
+		if (0 == strcmp(table->name, name))
+			return table;
+
+	return NULL;
+}
+
+static struct symbol *find_symbol(const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < assembler.symbols_count; i++)
+		if (0 == strcmp(assembler.symbols[i].name, name))
+			return &assembler.symbols[i];
+
+	return NULL;
+}
+
+static const struct symbol *find_register(const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(p16f1454) / sizeof(p16f1454[0]); i++)
+		if (0 == strcmp(p16f1454[i].name, name))
+			return &p16f1454[i];
+
+	return NULL;
+}
+
+static void define_symbol(const char *name, long value)
+{
+	struct symbol *symbol = find_symbol(name);
+
+	if (NULL == symbol)
+	{
+		if (SYMBOLS_MAX == assembler.symbols_count)
+			fatal("too many symbols");
+		symbol = &assembler.symbols[assembler.symbols_count++];
+		symbol->name = strdup(name);
+	}
+	symbol->value = value;
+}
+
+/* an undefined symbol is 0, and sets assembler.undefined */
+static long lookup(const char *name)
+{
+	const struct symbol *symbol = find_symbol(name);
+
+	if (NULL == symbol)
+		symbol = find_register(name);
+	if (NULL == symbol)
+	{
+		assembler.undefined = 1;
+		return 0;
+	}
+
+	return symbol->value;
+}
+
+/*
+    expressions, in gpasm's precedence, lowest first
+*/
+
+static const char *const binary_levels[][4] =
+{
+	{ "||" }, { "&&" }, { "|" }, { "^" }, { "&" }, { "==", "!=" }, { "<", ">", "<=", ">=" },
+	{ "<<", ">>" }, { "+", "-" }, { "*", "/", "%" },
+};
+#define BINARY_LEVELS			(sizeof(binary_levels) / sizeof(binary_levels[0]))
+
+static long parse_binary(const char **p, unsigned level);
+
+static void skip_spaces(const char **p)
+{
+	while (isspace((unsigned char)**p))
+		(*p)++;
+}
+
+static unsigned parse_name(const char **p, char *name)
+{
+	unsigned len = 0;
+
+	if (!isalpha((unsigned char)**p) && ('_' != **p))
+		return 0;
+	while ( (isalnum((unsigned char)(*p)[len]) || ('_' == (*p)[len])) && (len < NAME_MAX_LEN - 1) )
+	{
+		name[len] = (*p)[len];
+		len++;
+	}
+	name[len] = '\0';
+	*p += len;
+
+	return len;
+}
+
+/* the binary operator at p, if any: two-character ones first, so that "<<" isn't taken for "<" */
+static const char *peek_operator(const char *p)
+{
+	static const char *const operators[] = { "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "+", "-", "*", "/", "%", "&", "|", "^", "<", ">" };
+	unsigned i;
+
+	for (i = 0; i < sizeof(operators) / sizeof(operators[0]); i++)
+		if (0 == strncmp(p, operators[i], strlen(operators[i])))
+			return operators[i];
+
+	return NULL;
+}
+
+/* b'0101', h'1F', d'10', 'c', 0x1F and 10 */
+static int parse_number(const char **p, long *value)
+{
+	const char *s = *p;
+	char *end;
+	int base = 0;
+
+	if ( strchr("bBhHdD", s[0]) && s[0] && ('\'' == s[1]) )
+	{
+		base = ('b' == tolower((unsigned char)s[0])) ? 2 : ('h' == tolower((unsigned char)s[0])) ? 16 : 10;
+		*value = strtol(s + 2, &end, base);
+		if ( (end == s + 2) || ('\'' != *end) )
+			fatal("bad number");
+		*p = end + 1;
+		return 1;
+	}
+	if ('\'' == s[0])
+	{
+		if ( ('\\' == s[1]) && s[2] && ('\'' == s[3]) )
+		{
+			*value = (unsigned char)s[2];
+			*p = s + 4;
+			return 1;
+		}
+		if ( s[1] && ('\'' == s[2]) )
+		{
+			*value = (unsigned char)s[1];
+			*p = s + 3;
+			return 1;
+		}
+		fatal("bad character constant");
+	}
+	if (isdigit((unsigned char)s[0]))
+	{
+		if ( ('0' == s[0]) && ('x' == tolower((unsigned char)s[1])) )
+			*value = strtol(s + 2, &end, 16);
+		else
+			*value = strtol(s, &end, 10);
+		*p = end;
+		return 1;
+	}
+
+	return 0;
+}
+
+static long parse_unary(const char **p)
+{
+	char name[NAME_MAX_LEN];
+	const char *start;
+	long value;
+
+	skip_spaces(p);
+
+	switch (**p)
+	{
+	case '-': (*p)++; return -parse_unary(p);
+	case '~': (*p)++; return ~parse_unary(p);
+	case '!': (*p)++; return !parse_unary(p);
+	case '$': (*p)++; return assembler.pc;
+	case '(':
+		(*p)++;
+		value = parse_binary(p, 0);
+		skip_spaces(p);
+		if (')' != **p)
+			fatal("missing )");
+		(*p)++;
+		return value;
+	}
+
+	if (parse_number(p, &value))
+		return value;
+
+	start = *p;
+	if (0 == parse_name(p, name))
+		fatal("bad expression at \"%s\"", start);
+	if (0 == strcasecmp(name, "high"))
+		return (parse_unary(p) >> 8) & 0xFF;
+	if (0 == strcasecmp(name, "low"))
+		return parse_unary(p) & 0xFF;
+	if (0 == strcasecmp(name, "upper"))
+		return (parse_unary(p) >> 16) & 0xFF;
+
+	return lookup(name);
+}
+
+static long parse_binary(const char **p, unsigned level)
+{
+	const char *op;
+	long value, right;
+	unsigned i;
+
+	if (BINARY_LEVELS == level)
+		return parse_unary(p);
+
+	value = parse_binary(p, level + 1);
+	for (;;)
+	{
+		skip_spaces(p);
+		op = peek_operator(*p);
+		if (NULL == op)
+			return value;
+		for (i = 0; (i < 4) && binary_levels[level][i]; i++)
+			if (0 == strcmp(op, binary_levels[level][i]))
+				break;
+		if ( (4 == i) || (NULL == binary_levels[level][i]) )
+			return value;
+
+		*p += strlen(op);
+		right = parse_binary(p, level + 1);
+		switch (op[0] | (op[1] << 8))
+		{
+		case '|' | ('|' << 8): value = value || right; break;
+		case '&' | ('&' << 8): value = value && right; break;
+		case '=' | ('=' << 8): value = value == right; break;
+		case '!' | ('=' << 8): value = value != right; break;
+		case '<' | ('=' << 8): value = value <= right; break;
+		case '>' | ('=' << 8): value = value >= right; break;
+		case '<' | ('<' << 8): value = value << right; break;
+		case '>' | ('>' << 8): value = value >> right; break;
+		case '|': value |= right; break;
+		case '^': value ^= right; break;
+		case '&': value &= right; break;
+		case '<': value = value < right; break;
+		case '>': value = value > right; break;
+		case '+': value += right; break;
+		case '-': value -= right; break;
+		case '*': value *= right; break;
+		case '/':
+		case '%':
+			if (0 == right)
+				fatal("division by zero");
+			value = ('/' == op[0]) ? value / right : value % right;
+			break;
+		}
+	}
+}
+
+static long evaluate(const char *text, int *undefined)
+{
+	const char *p = text;
+	long value;
+
+	assembler.undefined = 0;
+	value = parse_binary(&p, 0);
+	skip_spaces(&p);
+	if (*p)
+		fatal("junk in expression \"%s\"", text);
+	*undefined = assembler.undefined;
+
+	return value;
+}
+
+/* an instruction operand: not needed on the first pass, and must be known on the second */
+static long operand(const char *text)
+{
+	int undefined;
+	long value;
+
+	if (1 == assembler.pass)
+		return 0;
+	value = evaluate(text, &undefined);
+	if (undefined)
+		fatal("undefined symbol in \"%s\"", text);
+
+	return value;
+}
+
+/*
+    source lines
+*/
+
+/* the position of the ';' that starts a comment, or of the end of the line */
+static size_t comment_start(const char *text)
+{
+	char quote = 0;
+	size_t i;
+
+	for (i = 0; text[i]; i++)
+	{
+		if (quote)
+		{
+			if (text[i] == quote)
+				quote = 0;
+		}
+		else if ( ('\'' == text[i]) || ('"' == text[i]) )
+			quote = text[i];
+		else if (';' == text[i])
+			break;
+	}
+
+	return i;
+}
+
+static char *trim(char *text)
+{
+	size_t len;
+
+	while (isspace((unsigned char)*text))
+		text++;
+	len = strlen(text);
+	while (len && isspace((unsigned char)text[len - 1]))
+		text[--len] = '\0';
+
+	return text;
+}
+
+/* split at the commas outside quotes and parentheses; operands are trimmed in place */
+static unsigned split_operands(char *text, char *operands[])
+{
+	unsigned count = 0, depth = 0;
+	char quote = 0, *start = text;
+
+	if ('\0' == *trim(text))
+		return 0;
+
+	for (;; text++)
+	{
+		if (quote)
+		{
+			if (*text == quote)
+				quote = 0;
+			continue;
+		}
+		if ( ('\'' == *text) || ('"' == *text) )
+			quote = *text;
+		else if ('(' == *text)
+			depth++;
+		else if ( (')' == *text) && depth )
+			depth--;
+		else if ( ('\0' == *text) || ( (',' == *text) && (0 == depth) ) )
+		{
+			if (OPERANDS_MAX == count)
+				fatal("too many operands");
+			operands[count++] = trim(start);
+			if ('\0' == *text)
+				break;
+			*text = '\0';
+			start = text + 1;
+		}
+	}
+
+	return count;
+}
+
+static struct line *read_lines(const char *path, unsigned *count)
+{
+	char buffer[LINE_MAX_LEN], *file = strdup(path);
+	struct line *lines = NULL;
+	unsigned allocated = 0;
+	size_t len;
+	FILE *input;
+
+	input = fopen(path, "rb");
+	if (NULL == input)
+		fatal("unable to open %s", path);
+
+	*count = 0;
+	while (fgets(buffer, sizeof(buffer), input))
+	{
+		len = strlen(buffer);
+		while (len && ( ('\r' == buffer[len - 1]) || ('\n' == buffer[len - 1]) ))
+			buffer[--len] = '\0';
+		if (*count == allocated)
+		{
+			allocated = allocated ? 2 * allocated : 256;
+			lines = realloc(lines, allocated * sizeof(*lines));
+			if (NULL == lines)
+				fatal("out of memory");
+		}
+		lines[*count].file = file;
+		lines[*count].number = *count + 1;
+		lines[*count].text = strdup(buffer);
+		(*count)++;
+	}
+
+	fclose(input);
+
+	return lines;
+}
+
+/*
+    code
+*/
+
+static void emit(long word)
+{
+	if ( (assembler.pc < 0) || (assembler.pc >= PM_SIZE_IN_WORDS) )
+		fatal("address 0x%04lX is outside program memory", assembler.pc);
+	if (2 == assembler.pass)
+	{
+		if (assembler.used[assembler.pc])
+			fatal("overwriting address 0x%04lX", assembler.pc);
+		assembler.code[assembler.pc] = word & 0x3FFF;
+		assembler.used[assembler.pc] = 1;
+	}
+	assembler.pc++;
+}
+
+/* ++FSRn, --FSRn, FSRn++, FSRn--, or k[FSRn] */
+static void indirect(int write, char *text)
+{
+	char *p = text, *q;
+	int pre = 0, post = 0, n;
+
+	for (q = text; *p; p++)
+		if (!isspace((unsigned char)*p))
+			*q++ = *p;
+	*q = '\0';
+
+	p = strchr(text, '[');
+	if (p)
+	{
+		if ( strncasecmp(p + 1, "FSR", 3) || !strchr("01", p[4]) || !p[4] || strcmp(p + 5, "]") )
+			fatal("bad indirect operand %s", text);
+		n = p[4] - '0';
+		*p = '\0';
+		emit((write ? 0x3F80 : 0x3F00) | (n << 6) | (operand(text) & 0x3F));
+		return;
+	}
+
+	p = text;
+	if ( (0 == strncmp(p, "++", 2)) || (0 == strncmp(p, "--", 2)) )
+	{
+		pre = *p;
+		p += 2;
+	}
+	if ( strncasecmp(p, "FSR", 3) || !p[3] || !strchr("01", p[3]) )
+		fatal("bad indirect operand %s", text);
+	n = p[3] - '0';
+	p += 4;
+	if ( (0 == strcmp(p, "++")) || (0 == strcmp(p, "--")) )
+		post = *p;
+	else if (*p)
+		fatal("bad indirect operand %s", text);
+	if ( !(pre || post) || (pre && post) )
+		fatal("bad indirect operand %s", text);
+
+	emit((write ? 0x0018 : 0x0010) | (n << 2) | ( ('+' == pre) ? 0 : ('-' == pre) ? 1 : ('+' == post) ? 2 : 3 ));
+}
+
+static void instruction(const char *op, char *args)
+{
+	const struct opcode *opcode;
+	char *operands[OPERANDS_MAX], *s;
+	unsigned count, i;
+	long offset;
+
+	count = split_operands(args, operands);
+
+	if (0 == strcmp(op, "dt"))
+	{
+		for (i = 0; i < count; i++)
+		{
+			if ('"' == operands[i][0])
+			{
+				for (s = operands[i] + 1; *s && ('"' != *s); s++)
+					emit(0x3400 | (unsigned char)*s);
+			}
+			else
+				emit(0x3400 | (operand(operands[i]) & 0xFF));
+		}
+		return;
+	}
+
+	if ( (opcode = find_opcode(implied_ops, op)) )
+	{
+		emit(opcode->bits);
+		return;
+	}
+	if ( (opcode = find_opcode(skip_ops, op)) )
+	{
+		emit(opcode->bits | STATUS);
+		return;
+	}
+
+	if (0 == count)
+		fatal("%s needs an operand", op);
+
+	if ( (opcode = find_opcode(byte_ops, op)) )
+		emit(opcode->bits | (((count > 1) ? operand(operands[1]) & 1 : 1) << 7) | (operand(operands[0]) & 0x7F));
+	else if ( (opcode = find_opcode(bit_ops, op)) )
+	{
+		if (count < 2)
+			fatal("%s needs a bit", op);
+		emit(opcode->bits | ((operand(operands[1]) & 7) << 7) | (operand(operands[0]) & 0x7F));
+	}
+	else if ( (opcode = find_opcode(literal_ops, op)) )
+		emit(opcode->bits | (operand(operands[0]) & 0xFF));
+	else if ( (opcode = find_opcode(branch_ops, op)) )
+	{
+		emit(opcode->bits | STATUS);
+		emit(0x2800 | (operand(operands[0]) & 0x7FF));
+	}
+	else if (0 == strcmp(op, "banksel"))
+		emit(0x0020 | ((operand(operands[0]) >> 7) & 0x1F));
+	else if (0 == strcmp(op, "movfw"))
+		emit(0x0800 | (operand(operands[0]) & 0x7F));
+	else if (0 == strcmp(op, "tstf"))
+		emit(0x0880 | (operand(operands[0]) & 0x7F));
+	else if (0 == strcmp(op, "clrf"))
+		emit(0x0180 | (operand(operands[0]) & 0x7F));
+	else if (0 == strcmp(op, "movwf"))
+		emit(0x0080 | (operand(operands[0]) & 0x7F));
+	else if (0 == strcmp(op, "movlb"))
+		emit(0x0020 | (operand(operands[0]) & 0x1F));
+	else if (0 == strcmp(op, "movlp"))
+		emit(0x3180 | (operand(operands[0]) & 0x7F));
+	else if (0 == strcmp(op, "goto"))
+		emit(0x2800 | (operand(operands[0]) & 0x7FF));
+	else if (0 == strcmp(op, "call"))
+		emit(0x2000 | (operand(operands[0]) & 0x7FF));
+	else if (0 == strcmp(op, "bra"))
+	{
+		offset = (2 == assembler.pass) ? operand(operands[0]) - (assembler.pc + 1) : 0;
+		if ( (offset < -256) || (offset > 255) )
+			fatal("bra out of range");
+		emit(0x3200 | (offset & 0x1FF));
+	}
+	else if ( (0 == strcmp(op, "moviw")) || (0 == strcmp(op, "movwi")) )
+		indirect('w' == op[3], operands[0]);
+	else if (0 == strcmp(op, "addfsr"))
+	{
+		if (count < 2)
+			fatal("addfsr needs a constant");
+		emit(0x3100 | ((0 == strcasecmp(operands[0], "FSR1")) << 6) | (operand(operands[1]) & 0x3F));
+	}
+	else
+		fatal("unknown instruction %s", op);
+}
+
+static int active(void)
+{
+	unsigned i;
+
+	for (i = 0; i < assembler.nesting_depth; i++)
+		if (!assembler.nesting[i].active)
+			return 0;
+
+	return 1;
+}
+
+static struct macro *find_macro(const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < assembler.macros_count; i++)
+		if (0 == strcmp(assembler.macros[i].name, name))
+			return &assembler.macros[i];
+
+	return NULL;
+}
+
+static int process(const struct line *lines, unsigned count);
+
+/* the body of the macro, with its parameters (whole words only) replaced by the arguments */
+static int expand(const struct macro *macro, char *args)
+{
+	char *operands[OPERANDS_MAX], name[NAME_MAX_LEN];
+	struct line *body;
+	const char *p, *start;
+	unsigned count, i, j, k;
+	size_t len;
+	int ended;
+
+	count = split_operands(args, operands);
+	body = calloc(macro->body_count, sizeof(*body));
+	if (NULL == body)
+		fatal("out of memory");
+
+	for (i = 0; i < macro->body_count; i++)
+	{
+		body[i] = macro->body[i];
+		body[i].text = malloc(LINE_MAX_LEN);
+		if (NULL == body[i].text)
+			fatal("out of memory");
+		body[i].text[0] = '\0';
+		len = 0;
+
+		for (p = macro->body[i].text; *p; )
+		{
+			start = p;
+			if ( (p == macro->body[i].text || !(isalnum((unsigned char)p[-1]) || ('_' == p[-1]))) && parse_name(&p, name) )
+			{
+				for (j = 0; j < macro->params_count; j++)
+					if ( (0 == strcmp(name, macro->params[j])) && (j < count) )
+						break;
+				if (j < macro->params_count)
+					start = operands[j];
+				else
+					start = name;
+				k = strlen(start);
+			}
+			else
+			{
+				p++;
+				k = 1;
+			}
+			if (len + k >= LINE_MAX_LEN)
+				fatal("macro expansion too long");
+			memcpy(body[i].text + len, start, k);
+			len += k;
+			body[i].text[len] = '\0';
+		}
+	}
+
+	ended = process(body, macro->body_count);
+
+	for (i = 0; i < macro->body_count; i++)
+		free(body[i].text);
+	free(body);
+
+	return ended;
+}
+
+/* returns nonzero when the end directive has been reached */
+static int process(const struct line *lines, unsigned count)
+{
+	char buffer[LINE_MAX_LEN], label[NAME_MAX_LEN], op[NAME_MAX_LEN], path[1024];
+	char *args, *operands[OPERANDS_MAX];
+	const struct line *saved_where = assembler.where;
+	const char *p;
+	struct macro *macro;
+	unsigned i, j, n;
+	int undefined, value;
+	long result;
+
+	for (i = 0; i < count; i++)
+	{
+		assembler.where = &lines[i];
+		strncpy(buffer, lines[i].text, sizeof(buffer) - 1);
+		buffer[sizeof(buffer) - 1] = '\0';
+		buffer[comment_start(buffer)] = '\0';
+		if ('\0' == *trim(buffer))
+			continue;
+
+		/* a label starts in the first column */
+		label[0] = '\0';
+		p = buffer;
+		if (!isspace((unsigned char)*p))
+		{
+			if (0 == parse_name(&p, label))
+				fatal("bad label");
+			if (':' == *p)
+				p++;
+		}
+		skip_spaces(&p);
+		for (n = 0; *p && !isspace((unsigned char)*p) && (n < NAME_MAX_LEN - 1); n++)
+			op[n] = tolower((unsigned char)*p++);
+		op[n] = '\0';
+		args = trim((char *)p);
+
+		/* conditionals are followed even where they are off */
+		if ( (0 == strcmp(op, "if")) || (0 == strcmp(op, "ifdef")) || (0 == strcmp(op, "ifndef")) )
+		{
+			if (NESTING_MAX == assembler.nesting_depth)
+				fatal("conditionals nested too deeply");
+			if (!active())
+				value = 0;
+			else if (0 == strcmp(op, "if"))
+			{
+				value = !!evaluate(args, &undefined);
+				if (undefined)
+					fatal("undefined symbol in \"%s\"", args);
+			}
+			else
+			{
+				value = (NULL != find_symbol(args)) || (NULL != find_register(args));
+				if ('n' == op[2])
+					value = !value;
+			}
+			assembler.nesting[assembler.nesting_depth].active = value;
+			assembler.nesting[assembler.nesting_depth].taken = value || !active();
+			assembler.nesting_depth++;
+			continue;
+		}
+		if (0 == strcmp(op, "else"))
+		{
+			if (0 == assembler.nesting_depth)
+				fatal("else without if");
+			assembler.nesting[assembler.nesting_depth - 1].active = !assembler.nesting[assembler.nesting_depth - 1].taken;
+			assembler.nesting[assembler.nesting_depth - 1].taken = 1;
+			continue;
+		}
+		if (0 == strcmp(op, "endif"))
+		{
+			if (0 == assembler.nesting_depth)
+				fatal("endif without if");
+			assembler.nesting_depth--;
+			continue;
+		}
+		if (!active())
+			continue;
+
+		if (0 == strcmp(op, "macro"))
+		{
+			if (MACROS_MAX == assembler.macros_count)
+				fatal("too many macros");
+			macro = &assembler.macros[assembler.macros_count++];
+			memset(macro, 0, sizeof(*macro));
+			strcpy(macro->name, label);
+			n = split_operands(args, operands);
+			if (n > PARAMS_MAX)
+				fatal("too many macro parameters");
+			for (j = 0; j < n; j++)
+				snprintf(macro->params[j], NAME_MAX_LEN, "%s", operands[j]);
+			macro->params_count = n;
+			macro->body = &lines[i + 1];
+			for (i++; ; i++)
+			{
+				if (i == count)
+					fatal("macro %s without endm", macro->name);
+				strncpy(buffer, lines[i].text, sizeof(buffer) - 1);
+				buffer[comment_start(buffer)] = '\0';
+				if (0 == strcasecmp(trim(buffer), "endm"))
+					break;
+			}
+			macro->body_count = &lines[i] - macro->body;
+			continue;
+		}
+
+		if (0 == strcmp(op, "equ"))
+		{
+			result = evaluate(args, &undefined);
+			if (undefined && (2 == assembler.pass))
+				fatal("undefined symbol in \"%s\"", args);
+			if (!undefined)
+				define_symbol(label, result);
+			continue;
+		}
+
+		if (0 == strcmp(op, "variable"))
+		{
+			p = args;
+			if ( (0 == parse_name(&p, label)) || (NULL == (p = strchr(p, '='))) )
+				fatal("bad variable");
+			result = evaluate(p + 1, &undefined);
+			if (undefined)
+				fatal("undefined symbol in \"%s\"", p + 1);
+			define_symbol(label, result);
+			continue;
+		}
+
+		if (label[0])
+			define_symbol(label, assembler.pc);
+		if ( ('\0' == op[0]) || (0 == strcmp(op, "radix")) || (0 == strcmp(op, "list")) || (0 == strcmp(op, "nolist")) ||
+			(0 == strcmp(op, "errorlevel")) || (0 == strcmp(op, "processor")) || (0 == strcmp(op, "title")) )
+			continue;
+
+		if (0 == strcmp(op, "end"))
+		{
+			assembler.where = saved_where;
+			return 1;
+		}
+
+		if (0 == strcmp(op, "include"))
+		{
+			struct line *included;
+
+			args = trim(args);
+			if ( ('"' == *args) || ('<' == *args) )
+				args++;
+			args[strcspn(args, "\">")] = '\0';
+			/* the registers are built in */
+			if (0 == strncasecmp(args, "p16f", 4))
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", assembler.directory, args);
+			included = read_lines(path, &n);
+			if (process(included, n))
+			{
+				assembler.where = saved_where;
+				return 1;
+			}
+			continue;
+		}
+
+		if (0 == strcmp(op, "error"))
+			fatal("error directive: %s", args);
+
+		if (0 == strcmp(op, "org"))
+		{
+			assembler.pc = evaluate(args, &undefined);
+			if (undefined)
+				fatal("undefined symbol in \"%s\"", args);
+			continue;
+		}
+
+		if (0 == strcmp(op, "__config"))
+		{
+			if (2 != split_operands(args, operands))
+				fatal("__config needs an address and a value");
+			if (2 == assembler.pass)
+			{
+				result = operand(operands[0]) - CONFIG_ADDRESS;
+				if ( (result < 0) || (result >= CONFIG_WORDS) )
+					fatal("bad configuration word address");
+				assembler.config[result] = operand(operands[1]) & 0x3FFF;
+				assembler.config_used[result] = 1;
+			}
+			continue;
+		}
+
+		/* macro names keep their case */
+		p = buffer;
+		if (!isspace((unsigned char)*p))
+		{
+			parse_name(&p, op);
+			if (':' == *p)
+				p++;
+		}
+		skip_spaces(&p);
+		for (n = 0; *p && !isspace((unsigned char)*p) && (n < NAME_MAX_LEN - 1); n++)
+			op[n] = *p++;
+		op[n] = '\0';
+		macro = find_macro(op);
+		if (macro)
+		{
+			if (expand(macro, args))
+			{
+				assembler.where = saved_where;
+				return 1;
+			}
+			continue;
+		}
+
+		for (n = 0; op[n]; n++)
+			op[n] = tolower((unsigned char)op[n]);
+		instruction(op, args);
+	}
+
+	assembler.where = saved_where;
+
+	return 0;
+}
+
+/* two passes, so that labels can be used before they are defined; the symbols of the first are kept for the second */
+static void assemble(const char *path, const struct symbol *defines, unsigned defines_count)
+{
+	struct line *lines;
+	char *directory, *slash;
+	unsigned count, i;
+
+	memset(&assembler, 0, sizeof(assembler));
+	directory = strdup(path);
+	slash = strrchr(directory, '/');
+	if (slash)
+		*slash = '\0';
+	else
+		strcpy(directory, ".");
+	assembler.directory = directory;
+
+	for (i = 0; i < defines_count; i++)
+		define_symbol(defines[i].name, defines[i].value);
+
+	lines = read_lines(path, &count);
+	for (assembler.pass = 1; assembler.pass <= 2; assembler.pass++)
+	{
+		assembler.pc = 0;
+		assembler.macros_count = 0;
+		assembler.nesting_depth = 0;
+		process(lines, count);
+		if (assembler.nesting_depth)
+			fatal("if without endif");
+	}
+	assembler.where = NULL;
+}
+
+/* Intel hex, as gpasm writes it: a record for each run of bytes within a 16 byte line, and CRLF line endings */
+static void write_record(FILE *output, unsigned address, unsigned type, const unsigned char *data, unsigned len)
+{
+	unsigned sum = len + ((address >> 8) & 0xFF) + (address & 0xFF) + type, i;
+
+	fprintf(output, ":%02X%04X%02X", len, address & 0xFFFF, type);
+	for (i = 0; i < len; i++)
+	{
+		fprintf(output, "%02X", data[i]);
+		sum += data[i];
+	}
+	fprintf(output, "%02X\r\n", (0x100 - (sum & 0xFF)) & 0xFF);
+}
+
+static void write_hex(const char *path)
+{
+	static unsigned long addresses[2 * (PM_SIZE_IN_WORDS + CONFIG_WORDS)];
+	static unsigned char bytes[2 * (PM_SIZE_IN_WORDS + CONFIG_WORDS)];
+	unsigned char data[16], upper_data[2];
+	unsigned long count = 0, i, j, upper = ~0UL;
+	unsigned len;
+	FILE *output;
+
+	for (i = 0; i < PM_SIZE_IN_WORDS; i++)
+	{
+		if (!assembler.used[i])
+			continue;
+		addresses[count] = 2 * i; bytes[count++] = assembler.code[i] & 0xFF;
+		addresses[count] = 2 * i + 1; bytes[count++] = assembler.code[i] >> 8;
+	}
+	for (i = 0; i < CONFIG_WORDS; i++)
+	{
+		if (!assembler.config_used[i])
+			continue;
+		addresses[count] = 2 * (CONFIG_ADDRESS + i); bytes[count++] = assembler.config[i] & 0xFF;
+		addresses[count] = 2 * (CONFIG_ADDRESS + i) + 1; bytes[count++] = assembler.config[i] >> 8;
+	}
+
+	output = fopen(path, "wb");
+	if (NULL == output)
+		fatal("unable to open output file %s", path);
+
+	for (i = 0; i < count; i = j)
+	{
+		if ((addresses[i] >> 16) != upper)
+		{
+			upper = addresses[i] >> 16;
+			upper_data[0] = (upper >> 8) & 0xFF;
+			upper_data[1] = upper & 0xFF;
+			write_record(output, 0, 4, upper_data, 2);
+		}
+		len = 0;
+		for (j = i; (j < count) && (addresses[j] == addresses[i] + len) && ((addresses[j] & ~0xFUL) == (addresses[i] & ~0xFUL)); j++)
+			data[len++] = bytes[j];
+		write_record(output, addresses[i] & 0xFFFF, 0, data, len);
+	}
+	fprintf(output, ":00000001FF\r\n");
+
+	fclose(output);
+}
+
+/*
+    the PIC16F1454 core
+*/
+
+static struct
+{
+	unsigned short flash[PM_SIZE_IN_WORDS];
+	unsigned char ram[0x1000];
+	unsigned char w;
+	unsigned pc;
+	unsigned stack[16];
+	unsigned sp;
+
+	unsigned long cycles;
+	double ns;
+	double lock_ns, pll_start;
+	int pll_on;
+	int asleep;
+	unsigned sleeps, sleep_nops;
+	unsigned char usb_flags;		/* UIR & UIE as it was, so that only new flags set USBIF */
+} pic;
+
+static void pic_reset(const unsigned char *image, double lock_us)
+{
+	unsigned i;
+
+	memset(&pic, 0, sizeof(pic));
+	for (i = 0; i < PM_SIZE_IN_WORDS; i++)
+		pic.flash[i] = image ? (image[2 * i] | (image[2 * i + 1] << 8)) & 0x3FFF : 0x3FFF;
+	for (i = 0; i < PM_SIZE_IN_WORDS; i++)
+		if (assembler.used[i])
+			pic.flash[i] = assembler.code[i];
+
+	pic.ram[STATUS] = 0x18;			/* NOT_TO and NOT_PD, after power-on */
+	pic.ram[PORTA] = 1 << 3;		/* RA3 high */
+	pic.lock_ns = lock_us * 1000.0;
+}
+
+static int pll_locked(void)
+{
+	return pic.pll_on && ( (pic.ns - pic.pll_start) >= pic.lock_ns );
+}
+
+static void tick(unsigned cycles)
+{
+	while (cycles--)
+	{
+		pic.ns += 4000.0 / (pll_locked() ? 48.0 : 16.0);
+		pic.cycles++;
+	}
+}
+
+/* a file register address, with the core registers and common RAM in every bank */
+static unsigned bank_address(unsigned f)
+{
+	if ( (f < 0x0C) || (f >= 0x70) )
+		return f;
+
+	return (pic.ram[BSR] & 0x1F) * 0x80 + f;
+}
+
+static unsigned fsr(unsigned n)
+{
+	return pic.ram[FSR0L + 2 * n] | (pic.ram[FSR0L + 2 * n + 1] << 8);
+}
+
+static void set_fsr(unsigned n, unsigned value)
+{
+	pic.ram[FSR0L + 2 * n] = value & 0xFF;
+	pic.ram[FSR0L + 2 * n + 1] = (value >> 8) & 0xFF;
+}
+
+static unsigned char read_file(unsigned address);
+static void write_file(unsigned address, unsigned value);
+
+/* FSR space: traditional data memory, linear data memory, and (read only) the low bytes of program memory */
+static unsigned char read_linear(unsigned address)
+{
+	address &= 0xFFFF;
+	if (address >= 0x8000)
+		return pic.flash[(address - 0x8000) & (PM_SIZE_IN_WORDS - 1)] & 0xFF;
+	if (address < 0x1000)
+		return read_file(address);
+	if ( (address >= 0x2000) && (address < 0x29B0) )
+		return read_file(((address - 0x2000) / 80) * 0x80 + 0x20 + (address - 0x2000) % 80);
+
+	return 0;
+}
+
+static void write_linear(unsigned address, unsigned value)
+{
+	address &= 0xFFFF;
+	if (address < 0x1000)
+		write_file(address, value);
+	else if ( (address >= 0x2000) && (address < 0x29B0) )
+		write_file(((address - 0x2000) / 80) * 0x80 + 0x20 + (address - 0x2000) % 80, value);
+}
+
+static unsigned char read_file(unsigned address)
+{
+	unsigned char value;
+
+	if ((address & 0x7F) < 2)
+		return read_linear(fsr(address & 0x7F));
+	if ((address & 0x7F) < 0x0C)
+		address &= 0x7F;
+	if (WREG == address)
+		return pic.w;
+	if (OSCSTAT == address)
+	{
+		value = HFIOFR | HFIOFS;
+		if (pll_locked())
+			value |= PLLRDY;
+		return value;
+	}
+
+	return pic.ram[address];
+}
+
+static void write_file(unsigned address, unsigned value)
+{
+	unsigned word;
+
+	value &= 0xFF;
+	if ((address & 0x7F) < 2)
+	{
+		write_linear(fsr(address & 0x7F), value);
+		return;
+	}
+	if ((address & 0x7F) < 0x0C)
+		address &= 0x7F;
+	if (WREG == address)
+	{
+		pic.w = value;
+		return;
+	}
+	if ( (OSCCON == address) && (value & SPLLEN) && !pic.pll_on )
+	{
+		pic.pll_on = 1;
+		pic.pll_start = pic.ns;
+	}
+	/* ACTVIF does not clear until the USB clock is running again */
+	if ( (UIR == address) && (pic.ram[UIR] & ACTVIF) && !pll_locked() )
+		value |= ACTVIF;
+	if ( (PMCON1 == address) && (value & PMCON1_RD) )
+	{
+		word = pic.flash[(pic.ram[PMADRL] | (pic.ram[PMADRH] << 8)) & (PM_SIZE_IN_WORDS - 1)];
+		pic.ram[PMDATL] = word & 0xFF;
+		pic.ram[PMDATH] = word >> 8;
+		value &= ~PMCON1_RD;
+	}
+
+	pic.ram[address] = value;
+}
+
+static void set_z(unsigned result)
+{
+	pic.ram[STATUS] = (pic.ram[STATUS] & ~STATUS_Z) | ( (result & 0xFF) ? 0 : STATUS_Z );
+}
+
+static void set_c(int carry)
+{
+	pic.ram[STATUS] = (pic.ram[STATUS] & ~STATUS_C) | (carry ? STATUS_C : 0);
+}
+
+static int wake_pending(void)
+{
+	return (pic.ram[PIR2] & USBIF) && (pic.ram[PIE2] & USBIE);
+}
+
+/* returns zero if the device is asleep with nothing to wake it */
+static int step(void)
+{
+	unsigned op, f, d, k, address, x, result = 0, n, mode, cycles = 1;
+	unsigned char flags;
+
+	/* a flag that has just been set (with its enable) sets USBIF */
+	flags = pic.ram[UIR] & pic.ram[UIE];
+	if (flags & ~pic.usb_flags)
+		pic.ram[PIR2] |= USBIF;
+	pic.usb_flags = flags;
+
+	if (pic.asleep)
+	{
+		if (!wake_pending())
+			return 0;
+		pic.asleep = 0;
+		/* the PLL has to lock again */
+		pic.pll_start = pic.ns;
+	}
+
+	op = pic.flash[pic.pc];
+	pic.pc = (pic.pc + 1) & 0x7FFF;
+	f = op & 0x7F;
+	d = (op >> 7) & 1;
+	k = op & 0xFF;
+
+	if (0x0000 == op)
+		;
+	else if (0x0008 == op)
+	{
+		pic.pc = pic.stack[--pic.sp & 15];
+		cycles = 2;
+	}
+	else if (0x0063 == op)
+	{
+		if (wake_pending())
+			pic.sleep_nops++;
+		else
+		{
+			pic.asleep = 1;
+			pic.sleeps++;
+		}
+	}
+	else if (0x0064 == op)
+		;
+	else if ((op & 0x3FE0) == 0x0020)
+		pic.ram[BSR] = op & 0x1F;
+	else if ((op & 0x3FF0) == 0x0010)
+	{
+		/* moviw/movwi with ++FSRn, --FSRn, FSRn++ or FSRn-- */
+		n = (op >> 2) & 1;
+		mode = op & 3;
+		address = fsr(n);
+		if (0 == mode)
+			set_fsr(n, ++address);
+		else if (1 == mode)
+			set_fsr(n, --address);
+		if (op & 0x8)
+			write_linear(address, pic.w);
+		else
+		{
+			pic.w = read_linear(address);
+			set_z(pic.w);
+		}
+		if (2 == mode)
+			set_fsr(n, address + 1);
+		else if (3 == mode)
+			set_fsr(n, address - 1);
+	}
+	else if ((op & 0x3F80) == 0x0080)
+		write_file(bank_address(f), pic.w);
+	else if ((op & 0x3F80) == 0x0180)
+	{
+		write_file(bank_address(f), 0);
+		set_z(0);
+	}
+	else if ((op & 0x3F80) == 0x0100)
+	{
+		pic.w = 0;
+		set_z(0);
+	}
+	else if ((op & 0x3000) == 0x0000)
+	{
+		x = read_file(bank_address(f));
+		switch (op & 0x3F00)
+		{
+		case 0x0700: result = x + pic.w; set_c(result > 0xFF); set_z(result); break;
+		case 0x0500: result = x & pic.w; set_z(result); break;
+		case 0x0900: result = ~x & 0xFF; set_z(result); break;
+		case 0x0300: result = (x - 1) & 0xFF; set_z(result); break;
+		case 0x0A00: result = (x + 1) & 0xFF; set_z(result); break;
+		case 0x0400: result = x | pic.w; set_z(result); break;
+		case 0x0800: result = x; set_z(result); break;
+		case 0x0D00: result = (x << 1) | (pic.ram[STATUS] & STATUS_C); set_c(x & 0x80); break;
+		case 0x0C00: result = (x >> 1) | ((pic.ram[STATUS] & STATUS_C) << 7); set_c(x & 1); break;
+		case 0x0200: result = (x - pic.w) & 0xFF; set_c(x >= pic.w); set_z(result); break;
+		case 0x0E00: result = ((x << 4) | (x >> 4)) & 0xFF; break;
+		case 0x0600: result = x ^ pic.w; set_z(result); break;
+		case 0x0B00:
+		case 0x0F00:
+			result = (x + ((0x0B00 == (op & 0x3F00)) ? 0xFF : 1)) & 0xFF;
+			if (0 == result)
+			{
+				pic.pc++;
+				cycles = 2;
+			}
+			break;
+		default:
+			fprintf(stderr, "ERROR: unsimulated instruction 0x%04X at 0x%03X\n", op, (pic.pc - 1) & 0x7FFF);
+			exit(-1);
+		}
+		if (d)
+			write_file(bank_address(f), result);
+		else
+			pic.w = result & 0xFF;
+	}
+	else if ((op & 0x3000) == 0x1000)
+	{
+		address = bank_address(f);
+		x = (op >> 7) & 7;
+		switch (op & 0x0C00)
+		{
+		case 0x0000: write_file(address, read_file(address) & ~(1 << x)); break;
+		case 0x0400: write_file(address, read_file(address) | (1 << x)); break;
+		case 0x0800:
+		case 0x0C00:
+			if ( ((read_file(address) >> x) & 1) == ((op & 0x0400) ? 1 : 0) )
+			{
+				pic.pc++;
+				cycles = 2;
+			}
+			break;
+		}
+	}
+	else if ((op & 0x3800) == 0x2000)
+	{
+		pic.stack[pic.sp++ & 15] = pic.pc;
+		pic.pc = ((pic.ram[PCLATH] & 0x78) << 8) | (op & 0x7FF);
+		cycles = 2;
+	}
+	else if ((op & 0x3800) == 0x2800)
+	{
+		pic.pc = ((pic.ram[PCLATH] & 0x78) << 8) | (op & 0x7FF);
+		cycles = 2;
+	}
+	else if ((op & 0x3F80) == 0x3180)
+		pic.ram[PCLATH] = op & 0x7F;
+	else if ((op & 0x3F00) == 0x3000)
+		pic.w = k;
+	else if ((op & 0x3F00) == 0x3400)
+	{
+		pic.w = k;
+		pic.pc = pic.stack[--pic.sp & 15];
+		cycles = 2;
+	}
+	else if ((op & 0x3F00) == 0x3E00)
+	{
+		result = pic.w + k;
+		set_c(result > 0xFF);
+		set_z(result);
+		pic.w = result & 0xFF;
+	}
+	else if ((op & 0x3F00) == 0x3900)
+		set_z(pic.w &= k);
+	else if ((op & 0x3F00) == 0x3800)
+		set_z(pic.w |= k);
+	else if ((op & 0x3F00) == 0x3A00)
+		set_z(pic.w ^= k);
+	else if ((op & 0x3F00) == 0x3C00)
+	{
+		set_c(k >= pic.w);
+		pic.w = (k - pic.w) & 0xFF;
+		set_z(pic.w);
+	}
+	else if ( ((op & 0x3F00) == 0x3500) || ((op & 0x3F00) == 0x3600) || ((op & 0x3F00) == 0x3700) )
+	{
+		x = read_file(bank_address(f));
+		if ((op & 0x3F00) == 0x3500)
+		{
+			set_c(x & 0x80);
+			result = (x << 1) & 0xFF;
+		}
+		else
+		{
+			set_c(x & 1);
+			result = (x >> 1) | ( ((op & 0x3F00) == 0x3700) ? (x & 0x80) : 0 );
+		}
+		set_z(result);
+		if (d)
+			write_file(bank_address(f), result);
+		else
+			pic.w = result;
+	}
+	else if ((op & 0x3F00) == 0x3F00)
+	{
+		/* moviw/movwi k[FSRn] */
+		n = (op >> 6) & 1;
+		address = fsr(n) + ( (op & 0x20) ? (op & 0x3F) - 0x40 : (op & 0x3F) );
+		if (op & 0x80)
+			write_linear(address, pic.w);
+		else
+		{
+			pic.w = read_linear(address);
+			set_z(pic.w);
+		}
+	}
+	else
+	{
+		fprintf(stderr, "ERROR: unsimulated instruction 0x%04X at 0x%03X\n", op, (pic.pc - 1) & 0x7FFF);
+		exit(-1);
+	}
+
+	tick(cycles);
+
+	return 1;
+}
+
+/*
+    the checks
+*/
+
+static const double lock_times_us[] = { 0, 500, 1000, 2000 };
+#define LOCK_TIMES			(sizeof(lock_times_us) / sizeof(lock_times_us[0]))
+#define CYCLES_MAX			100000000UL
+#define STEPS_MAX			200000UL
+
+static int run_boot(const char *image_path)
+{
+	static unsigned char image[2 * PM_SIZE_IN_WORDS];
+	FILE *input;
+	unsigned i;
+
+	input = fopen(image_path, "rb");
+	if (NULL == input)
+	{
+		fprintf(stderr, "ERROR: unable to open %s\n", image_path);
+		return -1;
+	}
+	memset(image, 0xFF, sizeof(image));
+	if (0 == fread(image, 1, sizeof(image), input))
+	{
+		fprintf(stderr, "ERROR: unable to read %s\n", image_path);
+		fclose(input);
+		return -1;
+	}
+	fclose(input);
+
+	for (i = 0; i < LOCK_TIMES; i++)
+	{
+		pic_reset(image, lock_times_us[i]);
+		while ( (APP_ENTRY_POINT != pic.pc) && (APP_B_ENTRY_POINT != pic.pc) )
+		{
+			if ( !step() || (pic.cycles > CYCLES_MAX) )
+			{
+				printf("PLL lock %4.0f us: the application was not started\n", lock_times_us[i]);
+				return -1;
+			}
+		}
+		printf("PLL lock %4.0f us: application at 0x%03X after %lu cycles, %.2f ms\n", lock_times_us[i], pic.pc, pic.cycles, pic.ns / 1e6);
+	}
+
+	return 0;
+}
+
+/* from the main loop, with the bus suspended and then resumed, back to the main loop with SUSPND and the flags clear */
+static int resumed(unsigned loop)
+{
+	return (loop == pic.pc) && !(pic.ram[UCON] & SUSPND) && !(pic.ram[UIR] & (ACTVIF | IDLEIF));
+}
+
+/* the bus is active from now on (resume signalling, then a SOF every frame), setting ACTVIF every 1 ms */
+static int bus_active(unsigned loop)
+{
+	unsigned long steps;
+	double next = pic.ns;
+
+	for (steps = 0; steps < STEPS_MAX; steps++)
+	{
+		if (pic.ns >= next)
+		{
+			pic.ram[UIR] |= ACTVIF;
+			next += 1e6;
+		}
+		/* asleep: on to the next activity, which may not wake it either */
+		if (!step())
+			pic.ns = next;
+		else if (resumed(loop))
+			return 1;
+	}
+
+	return 0;
+}
+
+static int run_wake(void)
+{
+	static const char *const names[] = { "bootloader_main_loop", "_usdone" };
+	unsigned long steps, cycles;
+	unsigned loop = 0, usdone = 0, address, i, stale, tried = 0, failed = 0;
+	struct symbol *symbol;
+	double ns;
+	int ok = 1;
+
+	for (i = 0; i < 2; i++)
+	{
+		symbol = find_symbol(names[i]);
+		if (NULL == symbol)
+		{
+			fprintf(stderr, "ERROR: %s not found; is this a SUSPEND_SLEEP build?\n", names[i]);
+			return -1;
+		}
+		if (0 == i)
+			loop = symbol->value;
+		else
+			usdone = symbol->value;
+	}
+	if (!find_symbol("_uactv"))
+	{
+		fprintf(stderr, "ERROR: not a SUSPEND_SLEEP build\n");
+		return -1;
+	}
+
+	/* suspend, 10 ms asleep, and resume; with and without an ACTVIF left over from before the suspend */
+	for (stale = 0; stale < 2; stale++)
+	{
+		for (i = 0; i < LOCK_TIMES; i++)
+		{
+			/* erased, so the bootloader stays */
+			pic_reset(NULL, lock_times_us[i]);
+			while (loop != pic.pc)
+				step();
+			for (steps = 0; steps < 200; steps++)
+				step();
+			if (stale)
+				pic.ram[UIR] |= ACTVIF;
+			pic.ram[UIR] |= IDLEIF;
+
+			for (steps = 0; (steps < STEPS_MAX) && step(); steps++)
+				;
+			if (!pic.asleep)
+			{
+				printf("FAIL stale ACTVIF %u, PLL lock %4.0f us: never slept (%u SLEEP NOPs)\n", stale, lock_times_us[i], pic.sleep_nops);
+				ok = 0;
+				continue;
+			}
+
+			pic.ns += 10e6;
+			pic.ram[UIR] |= ACTVIF;
+			cycles = pic.cycles;
+			ns = pic.ns;
+			for (steps = 0; (steps < STEPS_MAX) && step() && !resumed(loop); steps++)
+				;
+			if (!resumed(loop))
+			{
+				printf("FAIL stale ACTVIF %u, PLL lock %4.0f us: not back in the main loop after the resume\n", stale, lock_times_us[i]);
+				ok = 0;
+				continue;
+			}
+			printf("ok   stale ACTVIF %u, PLL lock %4.0f us: %u SLEEP NOPs, then slept; back in the main loop %lu cycles, %.2f us after the resume\n",
+				stale, lock_times_us[i], pic.sleep_nops, pic.cycles - cycles, (pic.ns - ns) / 1e3);
+		}
+	}
+
+	/* the bus resumes just before each instruction from the suspend to the SLEEP in turn: the device must not sleep through it */
+	for (i = 0; ; i++)
+	{
+		pic_reset(NULL, 0);
+		while (loop != pic.pc)
+			step();
+		pic.ram[UIR] |= IDLEIF;
+		while (usdone != pic.pc)
+			step();
+		for (steps = 0; (steps < i) && step(); steps++)
+			;
+		if (pic.asleep)
+			break;
+
+		tried++;
+		address = pic.pc;
+		if (!bus_active(loop))
+		{
+			printf("FAIL bus active from the instruction at 0x%03X: %s\n", address, pic.asleep ? "slept through it" : "not back in the main loop");
+			failed++;
+		}
+	}
+	printf("%s bus active from each of the %u instructions from _usdone to SLEEP: %u failed\n", failed ? "FAIL" : "ok  ", tried, failed);
+
+	return (ok && !failed) ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct symbol defines[DEFINES_MAX];
+	unsigned defines_count = 0, used = 0, i;
+	const char *hex_path = NULL, *image_path = NULL;
+	char *value;
+	int opt, wake = 0;
+
+	while ((opt = getopt(argc, argv, "D:o:b:w")) != -1)
+	{
+		switch (opt)
+		{
+		case 'D':
+			if (DEFINES_MAX == defines_count)
+				goto usage;
+			value = strchr(optarg, '=');
+			if (value)
+				*value++ = '\0';
+			defines[defines_count].name = optarg;
+			defines[defines_count++].value = value ? strtol(value, NULL, 0) : 1;
+			break;
+		case 'o': hex_path = optarg; break;
+		case 'b': image_path = optarg; break;
+		case 'w': wake = 1; break;
+		default: goto usage;
+		}
+	}
+
+	if (optind + 1 != argc)
+	{
+usage:
+		fprintf(stderr, "%s [-D symbol[=value]]... [-o hex | -b image | -w] <bootloader.asm>\n", argv[0]);
+		fprintf(stderr, "  -o  write the hex file\n");
+		fprintf(stderr, "  -b  time the boot to the application, with image (.dfu or binary) in flash\n");
+		fprintf(stderr, "  -w  check suspend, SLEEP and resume (SUSPEND_SLEEP builds)\n");
+		return -1;
+	}
+
+	assemble(argv[optind], defines, defines_count);
+
+	for (i = 0; i < BOOTLOADER_WORDS; i++)
+		used += assembler.used[i];
+	printf("%u of %u words used, %u free\n", used, BOOTLOADER_WORDS, BOOTLOADER_WORDS - used);
+
+	if (hex_path)
+		write_hex(hex_path);
+	if (image_path)
+		return run_boot(image_path);
+	if (wake)
+		return run_wake();
+
+	return 0;
+}
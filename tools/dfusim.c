@@ -0,0 +1,319 @@
+/*
+    simulated PIC16F1454 DFU bootloader for 454dfu
+
+    stands in for libusb and a board running bootloader.asm, so that 454dfu can
+    be exercised without hardware:
+
+    gcc -DDFUSIM 454dfu.c dfusim.c -o 454dfu-sim
+
+    the model follows bootloader.asm: DFU_UPLOAD and DFU_DNLOAD take wBlockNum as
+    the flash row index, rows below 0x200 (the bootloader) are write protected,
+    and the application is only started if the CRC-14 over 0x200 to 0x1F7F works
+    out to zero
+
+    time is simulated rather than taken from the wall clock: each control
+    transfer takes a 1 ms USB frame, and each row erase and write stalls the
+    device for 5 ms (2.5 ms worst case apiece)
+
+    environment variables:
+    DFUSIM_IMAGE       initial flash contents (a .dfu or 16384 byte binary); erased if not given
+    DFUSIM_SAVE        file to write the final flash contents to, e.g. for the next DFUSIM_IMAGE
+    DFUSIM_DROP_AFTER  disconnect after this many row writes on each connection, as a flaky hub would
+    DFUSIM_REENUM_MS   time taken to come back on the bus after a disconnect (default 1000)
+    DFUSIM_DUAL_SLOT   if 1, check the application as the DUAL_SLOT build of the bootloader does
+
+    Copyright (C) 2015 Peter Lawrence
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "dfusim.h"
+
+#define PM_SIZE_IN_BYTES		 16384
+#define	CODE_OFFSET_ADDRESS		 0x200
+#define	HIGH_ENDURANCE_ADDRESS	0x1F80
+#define	SLOT_B_ADDRESS			0x1200
+#define	SLOT_SELECT_ADDRESS		0x1FFF
+#define ROW_SIZE_IN_BYTES		    64
+#define HEF_ROW_FLAG			  0x80	/* in the high byte of a row's first word */
+#define USB_PRODUCT_ID			0x2002
+#define USB_VENDOR_ID			0x1209
+
+#define FRAME_US				  1000
+#define ROW_FLASH_US			  5000
+
+struct libusb_context
+{
+	unsigned char flash[PM_SIZE_IN_BYTES];
+	unsigned dnload_active:1;
+	unsigned connected:1;
+	unsigned long drop_after, reenum_us;
+	unsigned long writes_this_connection;
+	unsigned long long clock_us;
+	unsigned long transfers, row_writes, disconnects;
+};
+
+struct libusb_device_handle
+{
+	libusb_context *ctx;
+	unsigned claimed:1;
+};
+
+static libusb_context sim;
+
+static unsigned calc_modified_crc14(unsigned data, unsigned crc);
+static unsigned check_app(unsigned start, unsigned end);
+
+int libusb_init(libusb_context **ctx)
+{
+	FILE *input;
+	const char *env;
+	unsigned address;
+
+	memset(&sim, 0, sizeof(sim));
+	for (address = 0; address < PM_SIZE_IN_BYTES; address += 2)
+	{
+		sim.flash[address + 0] = 0xFF;
+		sim.flash[address + 1] = 0x3F;
+	}
+
+	env = getenv("DFUSIM_IMAGE");
+	if (env)
+	{
+		input = fopen(env, "rb");
+		if ( (NULL == input) || (PM_SIZE_IN_BYTES != fread(sim.flash, 1, PM_SIZE_IN_BYTES, input)) )
+		{
+			fprintf(stderr, "dfusim: unable to read %s\n", env);
+			return LIBUSB_ERROR_IO;
+		}
+		fclose(input);
+	}
+
+	env = getenv("DFUSIM_DROP_AFTER");
+	sim.drop_after = env ? strtoul(env, NULL, 0) : 0;
+	env = getenv("DFUSIM_REENUM_MS");
+	sim.reenum_us = 1000UL * (env ? strtoul(env, NULL, 0) : 1000);
+	sim.connected = 1;
+
+	if (ctx)
+		*ctx = &sim;
+	return LIBUSB_SUCCESS;
+}
+
+void libusb_exit(libusb_context *ctx)
+{
+	FILE *output;
+	const char *env;
+	unsigned slot;
+
+	(void)ctx;
+
+	env = getenv("DFUSIM_SAVE");
+	if (env)
+	{
+		output = fopen(env, "wb");
+		if ( (NULL == output) || (PM_SIZE_IN_BYTES != fwrite(sim.flash, 1, PM_SIZE_IN_BYTES, output)) )
+			fprintf(stderr, "dfusim: unable to write %s\n", env);
+		if (output)
+			fclose(output);
+	}
+
+	fprintf(stderr, "dfusim: %lu control transfers, %lu row writes, %lu disconnects, %.3f s simulated\n", sim.transfers, sim.row_writes, sim.disconnects, sim.clock_us / 1e6);
+
+	/* the checks made by bootloader_start */
+	env = getenv("DFUSIM_DUAL_SLOT");
+	if (env && atoi(env))
+	{
+		slot = sim.flash[(SLOT_SELECT_ADDRESS << 1) + 0] & 1;
+		if (check_app(slot ? SLOT_B_ADDRESS : CODE_OFFSET_ADDRESS, slot ? HIGH_ENDURANCE_ADDRESS : SLOT_B_ADDRESS))
+			slot ^= 1;
+		if (check_app(slot ? SLOT_B_ADDRESS : CODE_OFFSET_ADDRESS, slot ? HIGH_ENDURANCE_ADDRESS : SLOT_B_ADDRESS))
+			fprintf(stderr, "dfusim: neither slot passes its CRC-14; the bootloader stays resident\n");
+		else
+			fprintf(stderr, "dfusim: slot %c would start (selector prefers slot %c)\n", 'A' + slot, 'A' + (sim.flash[(SLOT_SELECT_ADDRESS << 1) + 0] & 1));
+	}
+	else
+	{
+		fprintf(stderr, "dfusim: application CRC-14 %s\n", check_app(CODE_OFFSET_ADDRESS, HIGH_ENDURANCE_ADDRESS) ? "fails; the bootloader stays resident" : "passes; the application would start");
+	}
+}
+
+libusb_device_handle *libusb_open_device_with_vid_pid(libusb_context *ctx, uint16_t vendor_id, uint16_t product_id)
+{
+	libusb_device_handle *handle;
+
+	(void)ctx;
+
+	if ( (USB_VENDOR_ID != vendor_id) || (USB_PRODUCT_ID != product_id) )
+		return NULL;
+
+	if (!sim.connected)
+	{
+		/* a bus reset puts bootloader.asm back in dfuIDLE */
+		sim.clock_us += sim.reenum_us;
+		sim.connected = 1;
+		sim.dnload_active = 0;
+	}
+
+	handle = (libusb_device_handle *)calloc(1, sizeof(libusb_device_handle));
+	if (handle)
+		handle->ctx = &sim;
+	sim.writes_this_connection = 0;
+	return handle;
+}
+
+void libusb_close(libusb_device_handle *dev_handle)
+{
+	free(dev_handle);
+}
+
+int libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number)
+{
+	if (!sim.connected)
+		return LIBUSB_ERROR_NO_DEVICE;
+	if (0 != interface_number)
+		return LIBUSB_ERROR_IO;
+	dev_handle->claimed = 1;
+	return LIBUSB_SUCCESS;
+}
+
+int libusb_release_interface(libusb_device_handle *dev_handle, int interface_number)
+{
+	(void)interface_number;
+
+	dev_handle->claimed = 0;
+	return sim.connected ? LIBUSB_SUCCESS : LIBUSB_ERROR_NO_DEVICE;
+}
+
+int libusb_control_transfer(libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout)
+{
+	unsigned char *row;
+
+	(void)wIndex; (void)timeout;
+
+	if (!sim.connected || !dev_handle->claimed)
+		return LIBUSB_ERROR_NO_DEVICE;
+
+	sim.transfers++;
+	sim.clock_us += FRAME_US;
+
+	/* set_pm_address only uses wValueL; _its_an_out sends a row flagged by 454hex2dfu --hef to the HEF rows */
+	if ( (0x21 == request_type) && (wLength >= 2) && (data[1] & HEF_ROW_FLAG) )
+		wValue |= 0xFC;
+	row = sim.flash + (wValue & 0xFF) * ROW_SIZE_IN_BYTES;
+
+	if ( (0x21 == request_type) && (1 == bRequest) ) /* DFU_DNLOAD */
+	{
+		if (0 == wLength)
+		{
+			sim.dnload_active = 0;
+			return 0;
+		}
+		if ( sim.drop_after && (sim.writes_this_connection == sim.drop_after) )
+		{
+			sim.connected = 0;
+			sim.disconnects++;
+			return LIBUSB_ERROR_NO_DEVICE;
+		}
+		if (wLength > ROW_SIZE_IN_BYTES)
+			return LIBUSB_ERROR_PIPE;
+		sim.dnload_active = 1;
+		sim.writes_this_connection++;
+		sim.row_writes++;
+		sim.clock_us += ROW_FLASH_US;
+		/* the bootloader's own rows are protected by _WRT_BOOT */
+		if ((wValue & 0xFF) >= (CODE_OFFSET_ADDRESS << 1) / ROW_SIZE_IN_BYTES)
+		{
+			memset(row, 0xFF, ROW_SIZE_IN_BYTES);
+			memcpy(row, data, wLength);
+			row[1] &= ~HEF_ROW_FLAG; /* PMDATH has no such bit */
+		}
+		return wLength;
+	}
+	else if ( (0xA1 == request_type) && (2 == bRequest) ) /* DFU_UPLOAD */
+	{
+		if (wValue > 255)
+			return 0;
+		if (wLength > ROW_SIZE_IN_BYTES)
+			wLength = ROW_SIZE_IN_BYTES;
+		memcpy(data, row, wLength);
+		return wLength;
+	}
+	else if ( (0xA1 == request_type) && (3 == bRequest) ) /* DFU_GETSTATUS */
+	{
+		static const unsigned char response[6] = { 0x00, 0x00, 0x00, 0x00, 0x02, 0x00 };
+
+		if (wLength > sizeof(response))
+			wLength = sizeof(response);
+		memcpy(data, response, wLength);
+		if (wLength > 4)
+			data[4] = sim.dnload_active ? 0x05 : 0x02; /* dfuDNLOAD-IDLE or dfuIDLE */
+		return wLength;
+	}
+
+	return LIBUSB_ERROR_PIPE;
+}
+
+const char *libusb_error_name(int errcode)
+{
+	switch (errcode)
+	{
+	case LIBUSB_SUCCESS:
+		return "LIBUSB_SUCCESS";
+	case LIBUSB_ERROR_IO:
+		return "LIBUSB_ERROR_IO";
+	case LIBUSB_ERROR_NO_DEVICE:
+		return "LIBUSB_ERROR_NO_DEVICE";
+	case LIBUSB_ERROR_PIPE:
+		return "LIBUSB_ERROR_PIPE";
+	default:
+		return "**UNKNOWN**";
+	}
+}
+
+/* the CRC-14 over start to end (word addresses), including the CRC in its last word: zero if valid */
+static unsigned check_app(unsigned start, unsigned end)
+{
+	unsigned address, crc;
+
+	crc = 0;
+	for (address = start << 1; address < (end << 1); address += 2)
+		crc = calc_modified_crc14((unsigned)sim.flash[address + 0] + ((unsigned)sim.flash[address + 1] << 8), crc);
+
+	return crc;
+}
+
+static unsigned calc_modified_crc14(unsigned data, unsigned crc)
+{
+	unsigned bit, result;
+
+	for (bit = 0; bit < 16; bit++)
+	{
+		result = (data & 0x0001) ^ (crc & 0x0001);
+		crc >>= 1;
+		if (result)
+			crc ^= 0x23B1;
+		data >>= 1;
+	}
+
+	return crc;
+}
@@ -0,0 +1,36 @@
+/*
+    simulated PIC16F1454 DFU bootloader for 454dfu
+
+    declares the subset of the libusb-1.0 interface used by 454dfu.c, so that it
+    can be built with -DDFUSIM against dfusim.c instead of libusb and run without
+    any hardware attached
+
+    the signatures match libusb's libusb.h
+*/
+
+#ifndef DFUSIM_H__
+#define DFUSIM_H__
+
+#include <stdint.h>
+
+typedef struct libusb_context libusb_context;
+typedef struct libusb_device_handle libusb_device_handle;
+
+enum libusb_error
+{
+	LIBUSB_SUCCESS = 0,
+	LIBUSB_ERROR_IO = -1,
+	LIBUSB_ERROR_NO_DEVICE = -4,
+	LIBUSB_ERROR_PIPE = -9,
+};
+
+int libusb_init(libusb_context **ctx);
+void libusb_exit(libusb_context *ctx);
+libusb_device_handle *libusb_open_device_with_vid_pid(libusb_context *ctx, uint16_t vendor_id, uint16_t product_id);
+void libusb_close(libusb_device_handle *dev_handle);
+int libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number);
+int libusb_release_interface(libusb_device_handle *dev_handle, int interface_number);
+int libusb_control_transfer(libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout);
+const char *libusb_error_name(int errcode);
+
+#endif /* DFUSIM_H__ */